@@ -10,4 +10,5 @@ FOUNDATION_EXPORT const unsigned char SwiftVisionVersionString[];
 
 #import "UIImage+OpenCV.h"
 #import "TextDewarper.h"
+#import "StreamingTextDewarper.h"
 #import "PageDetector.h"
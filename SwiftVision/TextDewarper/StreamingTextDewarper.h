@@ -0,0 +1,33 @@
+#import <UIKit/UIKit.h>
+#import "TextDewarperConfiguration.h"
+
+/**
+ * Dewarps a stream of camera frames of the same page.
+ *
+ * The first frame (and any frame where tracking is lost) goes through the full TextDewarper
+ * pipeline. After that, the contours of each frame are matched locally to the text lines
+ * found in the previous one: a contour joins the line whose fitted curve passes through it.
+ * Only the lines whose contours moved or changed are sampled and fitted again, contours no
+ * line reaches (text panning into view) start new lines, and the disparity model is only
+ * refitted when at least one line changed; otherwise the previous one is applied as is.
+ * A frame where more than a quarter of the contours match no line, or more than a quarter
+ * of the lines match no contour, is processed from scratch.
+ */
+@interface StreamingTextDewarper: NSObject
+- (instancetype _Nonnull)initWithConfiguration:(TextDewarperConfiguration *_Nonnull)configuration NS_DESIGNATED_INITIALIZER;
+- (instancetype _Nonnull)init NS_UNAVAILABLE;
+
+/// returns the dewarped working image for the next frame of the stream
+- (UIImage *_Nullable)dewarpFrame:(UIImage *_Nonnull)frame NS_SWIFT_NAME(dewarp(frame:));
+/// forgets all tracked lines; the next frame is processed from scratch
+- (void)reset;
+
+/// the number of text lines tracked in the last frame
+@property (nonatomic, assign, readonly) NSUInteger trackedLineCount;
+/// the number of those lines that had to be sampled and fitted again, or were started
+@property (nonatomic, assign, readonly) NSUInteger refittedLineCount;
+/// whether the disparity model was fitted again for the last frame
+@property (nonatomic, assign, readonly) BOOL refittedModel;
+/// the number of frames, since the last reset, that were processed from scratch
+@property (nonatomic, assign, readonly) NSUInteger rebuildCount;
+@end
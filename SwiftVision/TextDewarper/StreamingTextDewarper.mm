@@ -0,0 +1,246 @@
+#import <opencv2/opencv.hpp>
+#import "StreamingTextDewarper.h"
+#import "TextDewarper.h"
+// models
+#import "Contour.h"
+#import "ContourSpan.h"
+#import "DisparityModel.h"
+// private
+#import "Contour+internal.h"
+#import "ContourSpan+internal.h"
+#import "DisparityModel+internal.h"
+// extras
+#import "UIImage+OpenCV.h"
+#import "UIImage+Contour.h"
+#import "polyfit.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const double TRACK_BUCKET_HEIGHT = 32.0;   // px of image height per bucket of lines
+static const double TRACK_MAX_SHIFT = 1.0;        // px a line may move before it is fitted again
+static const double TRACK_MAX_UNMATCHED = 0.25;   // fraction of contours left unmatched before a rebuild
+static const double TRACK_MAX_LOST = 0.25;        // fraction of lines left empty before a rebuild
+
+/* A text line carried from one frame to the next */
+struct TrackedLine {
+    PolyFit<2> fit;                 /*!< y(x) through the key points            */
+    double xmin, xmax;              /*!< x extent of the key points             */
+    double offset;                  /*!< mean distance of the contour centers
+                                         below the fit, when it was fitted      */
+    int ncontours;                  /*!< contours when it was fitted            */
+    vector<Point2d> keyPoints;      /*!< key points it was fitted to            */
+};
+
+@interface StreamingTextDewarper () {
+    vector<TrackedLine> _lines;
+}
+@property (nonatomic, strong) TextDewarperConfiguration *configuration;
+@property (nonatomic, strong) DisparityModel *model;
+@property (nonatomic, assign) CGSize size;
+@end
+
+@implementation StreamingTextDewarper
+- (instancetype)initWithConfiguration:(TextDewarperConfiguration *)configuration {
+    self = [super init];
+    _configuration = configuration;
+    return self;
+}
+
+- (void)reset {
+    _lines.clear();
+    _model = nil;
+    _size = CGSizeZero;
+    _trackedLineCount = 0;
+    _refittedLineCount = 0;
+    _refittedModel = NO;
+    _rebuildCount = 0;
+}
+
+- (UIImage *)dewarpFrame:(UIImage *)frame {
+    UIImage *workingImage = [frame resizeTo:CGSizeMake(1440, 1920)];
+    UIImage *processedImage = [TextDewarper processedImage:workingImage configuration:self.configuration];
+    NSArray<Contour *> *contours = [processedImage contoursFilteredBy:nil usingConfiguration:self.configuration];
+
+    _refittedModel = NO;
+    if (!CGSizeEqualToSize(workingImage.size, self.size) || _lines.empty() ||
+        ![self trackContours:contours inImage:processedImage])
+        [self rebuildFromContours:contours inImage:processedImage];
+    self.size = workingImage.size;
+    _trackedLineCount = _lines.size();
+
+    if (_lines.empty()) {
+        self.model = nil;
+        return workingImage;
+    }
+    if (_refittedModel || !self.model) {
+        vector<vector<Point2d>> keyPoints;
+        for (size_t i = 0; i < _lines.size(); i++)
+            keyPoints.push_back(_lines[i].keyPoints);
+        DisparityModel *fitter = [[DisparityModel alloc] initWithImage:workingImage keyPoints:keyPoints];
+        self.model = [[DisparityModel alloc] initWithImage:workingImage fittedModel:[fitter fitModel]];
+        _refittedModel = YES;
+    }
+    return [self.model apply:DewarpOutputDewarped toImage:workingImage];
+}
+
+// MARK: - tracking
+- (void)rebuildFromContours:(NSArray<Contour *> *)contours inImage:(UIImage *)processedImage {
+    NSArray<ContourSpan *> *spans = [processedImage spansFromContours:contours usingConfiguration:self.configuration];
+
+    _lines.clear();
+    for (ContourSpan *span in spans) {
+        TrackedLine line;
+        if ([self fitLine:&line contours:span.contours keyPoints:span.keyPoints])
+            _lines.push_back(line);
+    }
+    _refittedLineCount = _lines.size();
+    _refittedModel = YES;
+    _rebuildCount++;
+}
+
+/// matches the contours to the lines of the previous frame, refits the lines that changed and
+/// starts new lines from the contours left over. returns NO, leaving the lines untouched, if too much of the page could not be matched.
+- (BOOL)trackContours:(NSArray<Contour *> *)contours inImage:(UIImage *)processedImage {
+    int i, b, nlines, nbuckets, unmatched, lost;
+    double reach = self.configuration.contourEdgeMaxLength;
+
+    /* Bucket the lines by the rows their curves cross, so each contour
+     * is only compared with the few lines near it. */
+    nlines = (int)_lines.size();
+    nbuckets = (int)(self.size.height / TRACK_BUCKET_HEIGHT) + 1;
+    vector<vector<int>> buckets(nbuckets);
+    for (i = 0; i < nlines; i++) {
+        const TrackedLine &line = _lines[i];
+        double y0 = line.fit(line.xmin), y1 = line.fit(0.5 * (line.xmin + line.xmax)), y2 = line.fit(line.xmax);
+        double ylo = min(y0, min(y1, y2)) + line.offset - TRACK_BUCKET_HEIGHT;
+        double yhi = max(y0, max(y1, y2)) + line.offset + TRACK_BUCKET_HEIGHT;
+        int blo = max(0, (int)(ylo / TRACK_BUCKET_HEIGHT));
+        int bhi = min(nbuckets - 1, (int)(yhi / TRACK_BUCKET_HEIGHT));
+        for (b = blo; b <= bhi; b++)
+            buckets[b].push_back(i);
+    }
+
+    /* Each contour joins the line whose curve passes closest to its
+     * center, within half its height */
+    NSMutableArray<NSMutableArray<Contour *> *> *assigned = [NSMutableArray arrayWithCapacity:nlines];
+    for (i = 0; i < nlines; i++)
+        [assigned addObject:[NSMutableArray array]];
+    NSMutableArray<Contour *> *unassigned = [NSMutableArray array];
+    for (Contour *contour in contours) {
+        double cx = contour.center.x, cy = contour.center.y;
+        double best = 0.5 * contour.bounds.size.height + 2.0;
+        int match = -1;
+        b = min(nbuckets - 1, max(0, (int)(cy / TRACK_BUCKET_HEIGHT)));
+        for (int l : buckets[b]) {
+            const TrackedLine &line = _lines[l];
+            if (cx < line.xmin - reach || cx > line.xmax + reach)
+                continue;
+            double d = fabs(cy - line.fit(cx) - line.offset);
+            if (d < best) {
+                best = d;
+                match = l;
+            }
+        }
+        if (match < 0)
+            [unassigned addObject:contour];
+        else
+            [assigned[match] addObject:contour];
+    }
+    unmatched = (int)unassigned.count;
+    for (lost = 0, i = 0; i < nlines; i++)
+        lost += assigned[i].count == 0;
+    if (unmatched > TRACK_MAX_UNMATCHED * contours.count || lost > TRACK_MAX_LOST * nlines)
+        return NO;
+
+    /* Only lines that gained or lost contours, or moved, are sampled and
+     * fitted again; the offset is compared with the one at the last fit
+     * so slow drift still triggers a refit. */
+    vector<TrackedLine> lines;
+    int refitted = 0;
+    for (i = 0; i < nlines; i++) {
+        NSArray<Contour *> *lineContours = [assigned[i] sortedArrayUsingComparator:^NSComparisonResult(Contour *c1, Contour *c2) {
+            if (CGRectGetMinX(c1.bounds) < CGRectGetMinX(c2.bounds))
+                return NSOrderedAscending;
+            else if (CGRectGetMinX(c1.bounds) > CGRectGetMinX(c2.bounds))
+                return NSOrderedDescending;
+            return NSOrderedSame;
+        }];
+        if (lineContours.count == 0)
+            continue;
+
+        TrackedLine &line = _lines[i];
+        if ((int)lineContours.count == line.ncontours &&
+            fabs([self offsetOfContours:lineContours fromLine:line] - line.offset) <= TRACK_MAX_SHIFT) {
+            lines.push_back(line);
+            continue;
+        }
+
+        CGFloat width = 0;
+        for (Contour *contour in lineContours)
+            width += contour.localxMax - contour.localxMin;
+        if (width <= self.configuration.contourSpanMinWidth)
+            continue;
+
+        ContourSpan *span = [[ContourSpan alloc] initWithImage:processedImage
+                                                      contours:lineContours
+                                              samplingInterval:self.configuration.contourSpanSamplingInterval];
+        TrackedLine refit;
+        if ([self fitLine:&refit contours:lineContours keyPoints:span.keyPoints]) {
+            lines.push_back(refit);
+            refitted++;
+        }
+    }
+
+    /* Contours that no line reached, such as text panning into view,
+     * are grouped into spans and start new lines. */
+    if (unmatched > 0) {
+        NSArray<ContourSpan *> *spans = [processedImage spansFromContours:unassigned usingConfiguration:self.configuration];
+        for (ContourSpan *span in spans) {
+            TrackedLine line;
+            if ([self fitLine:&line contours:span.contours keyPoints:span.keyPoints]) {
+                lines.push_back(line);
+                refitted++;
+            }
+        }
+        sort(lines.begin(), lines.end(), [](const TrackedLine &l1, const TrackedLine &l2) {
+            return l1.fit(0.5 * (l1.xmin + l1.xmax)) + l1.offset < l2.fit(0.5 * (l2.xmin + l2.xmax)) + l2.offset;
+        });
+    }
+
+    _refittedModel = refitted > 0 || (int)lines.size() != nlines;
+    _refittedLineCount = refitted;
+    _lines.swap(lines);
+    return YES;
+}
+
+- (BOOL)fitLine:(TrackedLine *)line contours:(NSArray<Contour *> *)contours keyPoints:(const vector<Point2d> &)keyPoints {
+    int i, n;
+
+    n = (int)keyPoints.size();
+    if (n < 3)
+        return NO;
+    vector<double> xs(n), ys(n);
+    for (i = 0; i < n; i++) {
+        xs[i] = keyPoints[i].x;
+        ys[i] = keyPoints[i].y;
+    }
+    if (line->fit.fit(&xs[0], &ys[0], n))
+        return NO;
+    line->xmin = *min_element(xs.begin(), xs.end());
+    line->xmax = *max_element(xs.begin(), xs.end());
+    line->keyPoints = keyPoints;
+    line->ncontours = (int)contours.count;
+    line->offset = 0.0;
+    line->offset = [self offsetOfContours:contours fromLine:*line];
+    return YES;
+}
+
+/// mean distance of the contour centers below the line's curve
+- (double)offsetOfContours:(NSArray<Contour *> *)contours fromLine:(const TrackedLine &)line {
+    double sum = 0.0;
+    for (Contour *contour in contours)
+        sum += contour.center.y - line.fit(contour.center.x);
+    return contours.count ? sum / contours.count : 0.0;
+}
+@end
@@ -19,8 +19,19 @@ typedef NS_ENUM(NSUInteger, ContourRenderingMode) {
 - (instancetype _Nonnull)initWithImage:(UIImage *_Nonnull)image configuration:(TextDewarperConfiguration *_Nonnull)configuration filteredBy:(nullable BOOL (^)(Contour *_Nonnull contour))filter;
 - (instancetype _Nonnull)init NS_UNAVAILABLE;
 
-/// returns the dewarped image
+/// returns the dewarped image, at the resolution of the input image.
+/// text is detected and the model fitted on the working image; only the final warp runs at full resolution.
 - (UIImage *_Nullable)dewarp NS_SWIFT_NAME(dewarp());
+/// returns the dewarped working image
+- (UIImage *_Nullable)dewarpWorkingImage NS_SWIFT_NAME(dewarpWorkingImage());
+
+/// writes the dewarp model fitted to this image, for pages taken from the same rig position
+- (BOOL)exportModelToPath:(NSString *_Nonnull)path NS_SWIFT_NAME(exportModel(to:));
+/// checks a few of the text lines detected on this image against an exported model;
+/// returns NO if they would not come out flat, and the model should be fitted again
+- (BOOL)validateModelAtPath:(NSString *_Nonnull)path NS_SWIFT_NAME(validateModel(at:));
+/// dewarps `image` with an exported model: no detection or fitting, just one resampling pass
++ (UIImage *_Nullable)dewarpImage:(UIImage *_Nonnull)image modelPath:(NSString *_Nonnull)path NS_SWIFT_NAME(dewarp(_:modelPath:));
 
 // returns thresholded input image
 - (UIImage *_Nullable)renderThresholded NS_SWIFT_NAME(renderThresholded());
@@ -33,6 +44,9 @@ typedef NS_ENUM(NSUInteger, ContourRenderingMode) {
 
 // returns pre-processed image (threshold, dilate, erode)
 - (UIImage *_Nullable)renderProcessed NS_SWIFT_NAME(renderProcessed());
+/// the preprocessing of `renderProcessed` for any working image: thresholded, dilated, eroded
+/// and masked to the configuration's `inputMaskInsets`, ready for contour detection
++ (UIImage *_Nullable)processedImage:(UIImage *_Nonnull)workingImage configuration:(TextDewarperConfiguration *_Nonnull)configuration NS_SWIFT_NAME(processedImage(_:configuration:));
 /// returns an image containing all the contour outlines
 - (UIImage *_Nullable)renderOutlines NS_SWIFT_NAME(renderOutlines());
 /// returns an image containing all the contours masks.
@@ -50,4 +64,20 @@ typedef NS_ENUM(NSUInteger, ContourRenderingMode) {
 @property (nonatomic, strong, readonly) UIImage *_Nonnull inputImage;
 // resized "working" copy of the image
 @property (nonatomic, strong, readonly) UIImage *_Nonnull workingImage;
+/// heap allocations made fitting and applying the disparities in the last `dewarp` or
+/// `dewarpWorkingImage`; zero once a page of the same size has been dewarped on the same thread
+@property (nonatomic, assign, readonly) NSUInteger allocationCount;
+/// the number of bytes those allocations requested
+@property (nonatomic, assign, readonly) NSUInteger bytesAllocated;
+
+/// contours dropped while detecting text, by the test that dropped them, for tuning the configuration.
+/// the tests run cheapest first and each contour is only counted by the first one it fails:
+/// blobs cleared by the blob prefilter before any outline was traced
+@property (nonatomic, assign, readonly) NSUInteger rejectedBlobCount;
+/// contours below the minimum width or height, or the minimum aspect
+@property (nonatomic, assign, readonly) NSUInteger rejectedBoundsCount;
+/// contours over the maximum thickness
+@property (nonatomic, assign, readonly) NSUInteger rejectedThicknessCount;
+/// contours turned down by the filter block
+@property (nonatomic, assign, readonly) NSUInteger rejectedFilterCount;
 @end
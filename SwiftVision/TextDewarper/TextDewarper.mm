@@ -15,6 +15,12 @@
 using namespace std;
 using namespace cv;
 
+/* preprocessing of the working image, before the contours are traced */
+static const float THRESHOLD_BLOCK_SIZE = 55;       // px neighborhood of the adaptive threshold
+static const float THRESHOLD_CONSTANT = 25;
+static const CGSize DILATE_KERNEL = { 9, 1 };       // joins the letters of a word along the line
+static const CGSize ERODE_KERNEL = { 1, 3 };        // parts lines that touch
+
 @interface TextDewarper ()
 @property (nonatomic, strong) TextDewarperConfiguration *configuration;
 @property (nonatomic, strong) NSArray<Contour *> *contours;
@@ -31,25 +37,30 @@ using namespace cv;
     self.inputImage = image;
     self.workingImage = [image resizeTo:CGSizeMake(1440, 1920)];
     self.configuration = configuration;
-    self.outline = [self outlineWithSize:self.workingImage.size insets:self.configuration.inputMaskInsets];
+    self.outline = [TextDewarper outlineWithSize:self.workingImage.size insets:self.configuration.inputMaskInsets];
     
     UIImage *processedImage = [self renderProcessed];
-    self.contours = [processedImage contoursFilteredBy:filter usingConfiguration:self.configuration];
+    ContourRejections rejections;
+    self.contours = [processedImage contoursFilteredBy:filter usingConfiguration:self.configuration rejections:&rejections];
+    _rejectedBlobCount = rejections.blobs;
+    _rejectedBoundsCount = rejections.bounds;
+    _rejectedThicknessCount = rejections.thickness;
+    _rejectedFilterCount = rejections.filter;
     self.spans = [processedImage spansFromContours:self.contours usingConfiguration:self.configuration];
 
     return self;
 }
 
 - (UIImage *)threshold {
-    return [self.workingImage threshold:55 constant:25];
+    return [self.workingImage threshold:THRESHOLD_BLOCK_SIZE constant:THRESHOLD_CONSTANT];
 }
 
 - (UIImage *)dilate {
-    return [[self threshold] dilate:CGSizeMake(9, 1)];
+    return [[self threshold] dilate:DILATE_KERNEL];
 }
 
 - (UIImage *)erode {
-    return [[self dilate] erode:CGSizeMake(1, 3)];
+    return [[self dilate] erode:ERODE_KERNEL];
 }
 
 - (UIImage *)mask {
@@ -61,14 +72,17 @@ using namespace cv;
     return [[self mask] rectangle:self.outline color:[[UIColor redColor] colorWithAlphaComponent:0.4]];
 }
 
-- (UIImage *)processedImage {
-    return [self erode];
-}
-
 // MARK: - returns pre-processed image
 - (UIImage *)renderProcessed {
-    UIImage *processedImage = [self processedImage];
-    UIImage *mask = [processedImage rectangle:self.outline];
+    return [TextDewarper processedImage:self.workingImage configuration:self.configuration];
+}
+
++ (UIImage *)processedImage:(UIImage *)workingImage configuration:(TextDewarperConfiguration *)configuration {
+    CGRectOutline outline = [self outlineWithSize:workingImage.size insets:configuration.inputMaskInsets];
+    UIImage *processedImage = [[[workingImage threshold:THRESHOLD_BLOCK_SIZE constant:THRESHOLD_CONSTANT]
+                                dilate:DILATE_KERNEL]
+                               erode:ERODE_KERNEL];
+    UIImage *mask = [processedImage rectangle:outline];
     return [processedImage elementwiseMinimum:mask];
 }
 
@@ -92,7 +106,36 @@ using namespace cv;
 - (UIImage *)dewarp {
     std::vector<std::vector<cv::Point2d>> allSpanPoints = [self allSamplePoints:self.spans];
     DisparityModel *disparity = [[DisparityModel alloc] initWithImage:self.workingImage keyPoints:allSpanPoints];
-    return [disparity apply];
+    /* detected and fitted on the working image, warped at full resolution */
+    UIImage *dewarped = [disparity apply:DewarpOutputDewarped toImage:self.inputImage];
+    _allocationCount = disparity.allocationCount;
+    _bytesAllocated = disparity.bytesAllocated;
+    return dewarped;
+}
+
++ (UIImage *)dewarpImage:(UIImage *)image modelPath:(NSString *)path {
+    DisparityModel *disparity = [[DisparityModel alloc] initWithImage:image modelPath:path];
+    return [disparity apply:DewarpOutputDewarped toImage:image];
+}
+
+- (BOOL)exportModelToPath:(NSString *)path {
+    std::vector<std::vector<cv::Point2d>> allSpanPoints = [self allSamplePoints:self.spans];
+    DisparityModel *disparity = [[DisparityModel alloc] initWithImage:self.workingImage keyPoints:allSpanPoints];
+    return [disparity exportModelToPath:path];
+}
+
+- (BOOL)validateModelAtPath:(NSString *)path {
+    DisparityModel *disparity = [[DisparityModel alloc] initWithImage:self.workingImage modelPath:path];
+    return [disparity validateModelWithKeyPoints:[self allSamplePoints:self.spans] maxLines:8 tolerance:2.0];
+}
+
+- (UIImage *)dewarpWorkingImage {
+    std::vector<std::vector<cv::Point2d>> allSpanPoints = [self allSamplePoints:self.spans];
+    DisparityModel *disparity = [[DisparityModel alloc] initWithImage:self.workingImage keyPoints:allSpanPoints];
+    UIImage *dewarped = [disparity apply];
+    _allocationCount = disparity.allocationCount;
+    _bytesAllocated = disparity.bytesAllocated;
+    return dewarped;
 }
 
 // MARK: - Debug
@@ -186,7 +229,7 @@ using namespace cv;
 }
 
 // MARK: -
-- (CGRectOutline)outlineWithSize:(CGSize)size insets:(UIEdgeInsets)insets {
++ (CGRectOutline)outlineWithSize:(CGSize)size insets:(UIEdgeInsets)insets {
     int xmin = 0;
     int ymin = 0;
     int xmax = int(size.width);
@@ -7,6 +7,7 @@
 @property (nonatomic, assign) int contourMinHeight;     // min px height of detected text contour
 @property (nonatomic, assign) float contourMinAspect;   // filter out text contours below this w/h ratio
 @property (nonatomic, assign) int contourMaxThickness;  // max px thickness of detected text contour
+@property (nonatomic, assign) BOOL contourBlobPrefilter;    // drop connected blobs under the size and aspect limits before tracing contours
 @property (nonatomic, assign) int contourSpanMinWidth;
 
 @property (nonatomic, assign) float contourEdgeMaxOverlap;  // max px horiz. overlap of contours in span
@@ -9,6 +9,7 @@
     self.contourMinHeight = 12;
     self.contourMinAspect = 1.5;
     self.contourMaxThickness = 26;
+    self.contourBlobPrefilter = YES;
 
     self.contourSpanMinWidth = 90;
 
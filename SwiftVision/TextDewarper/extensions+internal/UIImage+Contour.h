@@ -3,7 +3,21 @@
 @class Contour;
 @class ContourSpan;
 @class TextDewarperConfiguration;
+
+/// the contours dropped by each test of `contoursFilteredBy:`, cheapest first
+typedef struct {
+    NSUInteger blobs;       // blobs cleared by the blob prefilter, before any outline is traced
+    NSUInteger bounds;      // too small, or too tall for their width
+    NSUInteger thickness;   // too thick
+    NSUInteger filter;      // turned down by the filter block
+    NSUInteger accepted;    // the contours returned
+} ContourRejections;
+
 @interface UIImage (Contour)
 - (NSArray<Contour *> *_Nonnull)contoursFilteredBy:(nullable BOOL (^)(Contour *_Nonnull contour))filter usingConfiguration:(TextDewarperConfiguration *_Nonnull)configuration NS_SWIFT_NAME(contours(filteredBy:using:));
+/// as above, also counting the contours each test rejected into `rejections`
+- (NSArray<Contour *> *_Nonnull)contoursFilteredBy:(nullable BOOL (^)(Contour *_Nonnull contour))filter
+                                usingConfiguration:(TextDewarperConfiguration *_Nonnull)configuration
+                                        rejections:(ContourRejections *_Nullable)rejections;
 - (NSArray<ContourSpan *> *_Nonnull)spansFromContours:(NSArray<Contour *> *_Nonnull)contours  usingConfiguration:(TextDewarperConfiguration *_Nonnull)configuration NS_SWIFT_NAME(spans(from:using:));
 @end
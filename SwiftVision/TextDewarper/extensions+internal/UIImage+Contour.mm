@@ -9,6 +9,9 @@
 #import "Contour+internal.h"
 #import "ContourSpan+internal.h"
 #import "UIImage+Mat.h"
+#import "ContourBatch.hpp"
+#import "BlobScan.hpp"
+#import "PointGrid.hpp"
 
 using namespace std;
 using namespace cv;
@@ -16,39 +19,97 @@ using namespace cv;
 @implementation UIImage (Contour)
 // MARK: -
 - (NSArray<Contour *> *)contoursFilteredBy:(BOOL (^)(Contour *contour))filter usingConfiguration:(TextDewarperConfiguration *)configuration {
+    return [self contoursFilteredBy:filter usingConfiguration:configuration rejections:NULL];
+}
+
+- (NSArray<Contour *> *)contoursFilteredBy:(BOOL (^)(Contour *contour))filter
+                        usingConfiguration:(TextDewarperConfiguration *)configuration
+                                rejections:(ContourRejections *)rejections {
     Mat cvMat = [self grayScaleMat];
     NSMutableArray <Contour *> *foundContours = @[].mutableCopy;
     vector<vector<cv::Point> > contours;
+    ContourRejections counts = {};
+    if (configuration.contourBlobPrefilter)
+        counts.blobs = [self eraseRejectedBlobs:cvMat usingConfiguration:configuration];
     findContours(cvMat, contours, RETR_EXTERNAL, CHAIN_APPROX_NONE);
 
-    for (int j = 0; j < contours.size(); j++) {
-        vector<cv::Point> points = contours.at(j);
-        cv::Rect rect = cv::boundingRect(points);
-        if (rect.width < configuration.contourMinWidth ||
-            rect.height < configuration.contourMinHeight ||
-            rect.width < configuration.contourMinAspect * rect.height)
-            continue;
+    /**
+     * The features of all contours come from one batch, a tier at a
+     * time, and each test runs as soon as the tier it needs is in:
+     * a contour rejected on its bounds never has its moments taken,
+     * and only contours that pass every numeric test become objects
+     * for the filter block.
+     **/
+    ContourBatch batch;
+    size_t npoints = 0;
+    for (size_t j = 0; j < contours.size(); j++)
+        npoints += contours[j].size();
+    batch.reserve((int)contours.size(), (int)npoints);
+    for (size_t j = 0; j < contours.size(); j++)
+        batch.add(&contours[j][0].x, (int)contours[j].size());
+
+    batch.compute(CONTOUR_BOUNDS);
+    for (int j = 0; j < batch.count(); j++) {
+        int width = batch.boundsWidth(j);
+        int height = batch.boundsHeight(j);
+        if (width < configuration.contourMinWidth ||
+            height < configuration.contourMinHeight ||
+            width < configuration.contourMinAspect * height) {
+            batch.reject(j);
+            counts.bounds++;
+        }
+    }
 
-        Contour *contour = [[Contour alloc] initWithCVMat:Mat(points)];
+    batch.compute(CONTOUR_PROFILE);
+    for (int j = 0; j < batch.count(); j++) {
+        if (!batch.rejected(j) && batch.thickness(j) > configuration.contourMaxThickness) {
+            batch.reject(j);
+            counts.thickness++;
+        }
+    }
 
-        if (filter)
-            if (!filter(contour))
-                continue;
+    for (int j = 0; j < batch.count(); j++) {
+        if (batch.rejected(j))
+            continue;
 
-        Mat summedMask = Mat::zeros(0, 0, CV_64FC1);
-        cv::reduce(contour.mask, summedMask, 0, REDUCE_SUM, CV_64FC1);
+        Contour *contour = [[Contour alloc] initWithBatch:batch index:j];
 
-        double max;
-        minMaxLoc(summedMask, NULL, &max);
-        if (max > configuration.contourMaxThickness)
-           continue;
+        if (filter && !filter(contour)) {
+            counts.filter++;
+            continue;
+        }
 
         [foundContours addObject:contour];
     }
 
+    counts.accepted = foundContours.count;
+    if (rejections)
+        *rejections = counts;
     return foundContours;
 }
 
+/// clears every blob of `cvMat` that fails the size or aspect limits, so findContours only traces
+/// the ones that can pass. the bounds of a blob are those of its outline, so this rejects exactly
+/// what the bounds test would; the thickness is left to the outline. returns the number of blobs cleared.
+- (NSUInteger)eraseRejectedBlobs:(Mat)cvMat usingConfiguration:(TextDewarperConfiguration *)configuration {
+    BlobScan scan;
+    NSUInteger rejected = 0;
+    if (scan.scan(cvMat.data, cvMat.cols, cvMat.rows, (int)cvMat.step))
+        return 0;
+
+    vector<uint8_t> keep(scan.count());
+    for (int k = 0; k < scan.count(); k++) {
+        const BlobStats &blob = scan.blob(k);
+        keep[k] = !(blob.width < configuration.contourMinWidth ||
+                    blob.height < configuration.contourMinHeight ||
+                    blob.width < configuration.contourMinAspect * blob.height);
+        rejected += !keep[k];
+    }
+    if (!keep.empty())
+        scan.erase(&keep[0], cvMat.data, (int)cvMat.step);
+    return rejected;
+}
+
 - (NSArray<ContourSpan *> *)spansFromContours:(NSArray<Contour *> *)contours usingConfiguration:(TextDewarperConfiguration *)configuration {
     NSArray <Contour *> *sortedContours = [self sortContoursByBounds:contours];
     NSArray <ContourEdge *> *edges = [self generateContourEdgesFromContours:sortedContours usingConfiguration:configuration];
@@ -108,19 +169,37 @@ using namespace cv;
     NSMutableArray <ContourEdge *> *edges = @[].mutableCopy;
     NSInteger contourCount = contours.count;
 
+    /**
+     * An edge runs from the end (clxMax) of one contour to the start
+     * (clxMin) of the other, so only pairs with a start within
+     * contourEdgeMaxLength of an end can pass.  A grid over the starts
+     * finds those without looking at every pair; the edges are then
+     * built and tested as before, in the same order.  The pixel of
+     * slack covers the float distance the edge is measured with.
+     **/
+    vector<double> startx(contourCount), starty(contourCount), endx(contourCount), endy(contourCount);
     for (int i = 0; i < contourCount; i++) {
-        Contour *currentContour = contours[i];
-        for (int j = 0; j < i; j++) {
-            Contour *adjacentContour = contours[j];
-            ContourEdge *edge = [currentContour contourEdgeWithAdjacentContour:adjacentContour];
-
-            if (edge.distance > configuration.contourEdgeMaxLength ||
-                edge.overlap > configuration.contourEdgeMaxOverlap ||
-                edge.angle > configuration.contourEdgeMaxAngle)
-                continue;
+        startx[i] = contours[i].clxMin.x;
+        starty[i] = contours[i].clxMin.y;
+        endx[i] = contours[i].clxMax.x;
+        endy[i] = contours[i].clxMax.y;
+    }
+    vector<pair<int, int>> candidates;
+    if (contourCount > 0)
+        PointGrid::pairsWithin(&startx[0], &starty[0], &endx[0], &endy[0], (int)contourCount,
+                               configuration.contourEdgeMaxLength + 1.0, &candidates);
+
+    for (size_t k = 0; k < candidates.size(); k++) {
+        Contour *currentContour = contours[candidates[k].first];
+        Contour *adjacentContour = contours[candidates[k].second];
+        ContourEdge *edge = [currentContour contourEdgeWithAdjacentContour:adjacentContour];
+
+        if (edge.distance > configuration.contourEdgeMaxLength ||
+            edge.overlap > configuration.contourEdgeMaxOverlap ||
+            edge.angle > configuration.contourEdgeMaxAngle)
+            continue;
 
-            [edges addObject:edge];
-        }
+        [edges addObject:edge];
     }
     return edges;
 }
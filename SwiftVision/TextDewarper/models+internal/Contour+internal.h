@@ -3,18 +3,21 @@
 
 #import <opencv2/opencv.hpp>
 
+class ContourBatch;
+
 @interface Contour ()
 // the original opencv mat.
 @property (nonatomic, assign) cv::Mat opencvContour;
-// a bounding box mask of the contour (non minimum)
-@property (nonatomic, assign, readonly) cv::Mat mask;
+// the most outline pixels in any column of the bounds
+@property (nonatomic, assign, readonly) int thickness;
+// the mean row of the outline pixels in each column of the bounds, from the top of the bounds
+@property (nonatomic, assign, readonly) std::vector<float> columnMeans;
 @property (nonatomic, assign, readonly) CGPoint clxMin;
 @property (nonatomic, assign, readonly) CGPoint clxMax;
-@property (nonatomic, strong, readonly) NSArray <NSNumber *> *_Nonnull clx;
-@property (nonatomic, assign, readonly) NSArray <NSValue *> *_Nonnull points;
-@property (nonatomic, assign) cv::Moments moments;
 /// returns the contour from a Mat
-- (instancetype _Nonnull)initWithCVMat:(cv::Mat)cvMat NS_DESIGNATED_INITIALIZER;
+- (instancetype _Nonnull)initWithCVMat:(cv::Mat)cvMat;
+/// returns contour `index` of a batch, taking the features it computed
+- (instancetype _Nonnull)initWithBatch:(const ContourBatch &)batch index:(int)index NS_DESIGNATED_INITIALIZER;
 /// constructs a contourEdge with an adjacent contour
 - (ContourEdge *_Nullable)contourEdgeWithAdjacentContour:(Contour *_Nonnull)adjacentContour;
 // returns the minimum bounding box vertices of the contour
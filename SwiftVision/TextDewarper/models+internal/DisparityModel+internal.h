@@ -0,0 +1,14 @@
+#ifndef DisparityModel_internal_h
+#define DisparityModel_internal_h
+
+#import "DisparityModel.h"
+
+class DewarpModel;
+@interface DisparityModel ()
+/// creates a model that applies `model` instead of fitting one; takes ownership of `model`.
+- (instancetype _Nonnull)initWithImage:(UIImage *_Nonnull)image fittedModel:(DewarpModel *_Nonnull)model;
+/// fits the disparities to the key points; the caller owns the result.
+- (DewarpModel *_Nonnull)fitModel;
+@end
+
+#endif /* DisparityModel_internal_h */
@@ -6,45 +6,60 @@
 #import "ContourEdge+internal.h"
 #import "Contour+internal.h"
 // extras
-#import "NSArray+extras.h"
 #import "UIColor+extras.h"
 #import "math.hpp"
+#import "ContourBatch.hpp"
 
 using namespace cv;
 
 // MARK: -
 @implementation Contour
 - (instancetype)initWithCVMat:(Mat)cvMat {
-    self = [super init];
-    self.opencvContour = cvMat.clone();
-
-    cv::Rect boundingRect = cv::boundingRect(self.opencvContour);
-    _size = self.opencvContour.total();
-    _bounds = CGRectMake(boundingRect.x, boundingRect.y, boundingRect.width, boundingRect.height);
-    _aspect = boundingRect.height / boundingRect.width;
-    _mask = [self generateMaskFromContour: self.opencvContour];
-
-    _area = contourArea(self.opencvContour);
-    _moments = moments(self.opencvContour);
+    ContourBatch batch;
+    Mat points = cvMat.isContinuous() ? cvMat : cvMat.clone();
+    batch.add((const int *)points.data, (int)points.total());
+    batch.compute();
+    return [self initWithBatch:batch index:0];
+}
 
-    _points = [self getPointsFromMat:self.opencvContour];
-    _tangent = [self calculateTangent:self.opencvContour];
-    _center = [self calculateCenter:self.opencvContour];
-    _clx = [self projectContourPoints:self.points];
+- (instancetype)initWithBatch:(const ContourBatch &)batch index:(int)index {
+    self = [super init];
+    int n = batch.size(index);
+    const double *xs = batch.x(index);
+    const double *ys = batch.y(index);
+    Mat contour = Mat(n, 1, CV_32SC2);
+    for (int i = 0; i < n; i++)
+        contour.at<cv::Point>(i) = cv::Point((int)xs[i], (int)ys[i]);
+    self.opencvContour = contour;
+
+    _size = n;
+    _bounds = CGRectMake(batch.boundsX(index), batch.boundsY(index), batch.boundsWidth(index), batch.boundsHeight(index));
+    _aspect = batch.boundsHeight(index) / batch.boundsWidth(index);
+    _thickness = batch.thickness(index);
+    _columnMeans = std::vector<float>(batch.columnMeans(index), batch.columnMeans(index) + batch.boundsWidth(index));
+
+    _area = batch.area(index);
+    _tangent = CGPointMake(batch.tangentX(index), batch.tangentY(index));
+    _center = CGPointMake(batch.centerX(index), batch.centerY(index));
     _angle = atan2(self.tangent.y, self.tangent.x);
 
-    double min = self.clx.min.floatValue;
-    double max = self.clx.max.floatValue;
+    double min = batch.clxMin(index);
+    double max = batch.clxMax(index);
     _clxMin = CGPointMake(self.center.x + self.tangent.x * min, self.center.y + self.tangent.y * min);
     _clxMax = CGPointMake(self.center.x + self.tangent.x * max, self.center.y + self.tangent.y * max);
     _localxMin = min;
     _localxMax = max;
 
-    _color = [UIColor randomColor];
-
     return self;
 }
 
+- (UIColor *)color {
+    /* only contours that get drawn need one */
+    if (!_color)
+        _color = [UIColor randomColor];
+    return _color;
+}
+
 - (NSString *)description {
     NSMutableString *formatedDesc = [NSMutableString string];
     [formatedDesc appendFormat:@"<%@: %p", NSStringFromClass([self class]), self];
@@ -62,27 +77,7 @@ using namespace cv;
 - (void)dealloc {
 }
 
-// MARK: -
-- (NSMutableArray <NSValue *> *)getPointsFromMat:(Mat)mat {
-    NSMutableArray <NSValue *> *points = @[].mutableCopy;
-    for (int i = 0; i < mat.total(); i++) {
-        cv::Point p = mat.at<cv::Point>(i);
-        [points addObject:[NSValue valueWithCGPoint:CGPointMake(p.x, p.y)]];
-    }
-    return points;
-}
-
 // MARK: - Contour projection
-- (NSArray<NSNumber *> *)projectContourPoints:(NSArray<NSValue *> *)points {
-    NSMutableArray *dots = @[].mutableCopy;
-    for (int i = 0; i < self.size; i++) {
-        CGPoint p = [points[i] CGPointValue];
-        double projected = [self projectPoint:p];
-        [dots addObject:[NSNumber numberWithDouble:projected]];
-    }
-    return dots;
-}
-
 - (double)projectPoint:(CGPoint)point {
     Point2d t = Point2d(self.tangent.x, self.tangent.y);
     Point2d c = Point2d(self.center.x, self.center.y);
@@ -90,51 +85,10 @@ using namespace cv;
     return t.ddot(d);
 }
 
-// MARK: - Attribute calculation
-- (CGPoint)calculateCenter:(Mat)mat {
-    double area = self.moments.m00;
-    double m10 = self.moments.m10;
-    double m01 = self.moments.m01;
-    double meanX = m10 / area;
-    double meanY = m01 / area;
-
-    double centerPoints[2] = {meanX, meanY};
-    Mat center = Mat(2, 1, CV_64FC1, &centerPoints);
-
-    double x = center.at<double>(0, 0);
-    double y = center.at<double>(1, 0);
-
-    return CGPointMake(x, y);
-}
-
-- (CGPoint)calculateTangent:(Mat)mat {
-    double area = self.moments.m00;
-    double mu20 = self.moments.mu20;
-    double mu11 = self.moments.mu11;
-    double mu02 = self.moments.mu02;
-
-    double data[4] = {mu20, mu11, mu11, mu02};
-    Mat momentsMatrix = Mat(2, 2, CV_64FC1, &data);
-    momentsMatrix /= area;
-
-    Mat svdW;
-    Mat svdU;
-    Mat svdVT;
-    SVDecomp(momentsMatrix, svdW, svdU, svdVT);
-
-    Mat tangent = svdU.col(0).clone();
-
-    double x = tangent.at<double>(0, 0);
-    double y = tangent.at<double>(0, 1);
-    return CGPointMake(x, y);
-}
-
 - (double)contourOverlap:(Contour *)otherContour {
     double xmin = [self projectPoint:otherContour.clxMin];
     double xmax = [self projectPoint:otherContour.clxMax];
-    double clxMin = self.clx.min.doubleValue;
-    double clxMax = self.clx.max.doubleValue;
-    CGPoint localRng = CGPointMake(clxMin, clxMax);
+    CGPoint localRng = CGPointMake(self.localxMin, self.localxMax);
     CGPoint projectedRng = CGPointMake(xmin, xmax);
 
     return MIN(localRng.y, projectedRng.y) - MAX(localRng.x, projectedRng.x);
@@ -174,24 +128,6 @@ using namespace cv;
     return [[ContourEdge alloc] initWithDistance:dist angle:deltaAngle overlap:xOverlap contourA:contourA contourB:contourB];
 }
 
-- (Mat)generateMaskFromContour:(cv::Mat)mat {
-    int originx = int(self.bounds.origin.x);
-    int originy = int(self.bounds.origin.y);
-    int width = int(self.bounds.size.width);
-    int height = int(self.bounds.size.height);
-
-    Mat tight_mask = Mat::zeros(height, width, CV_32FC1);
-    Mat tight_contour = Mat(mat);
-
-    int rowCnt = tight_contour.rows;
-    for (int h = 0; h < rowCnt; h++) {
-        int tightX = tight_contour.at<int>(h, 0);
-        int tightY = tight_contour.at<int>(h, 1);
-        tight_mask.at<float>(tightY - originy, tightX - originx) = 1.0;
-    }
-    return tight_mask;
-}
-
 - (cv::Point2f)convert:(CGPoint)p {
     return Point2f(p.x, p.y);
 }
@@ -43,24 +43,15 @@ using namespace cv;
     std::vector<Point2d> contourPoints;
     std::vector<std::vector<Point2d>> spanPoints;
     for (Contour *contour in contours) {
-        Mat mask = contour.mask.clone();
-        std::vector<double> points = vectors::linspace(0, mask.rows-1, mask.rows);
-        for (int i = 0; i < points.size(); i++) {
-            mask.row(i) *= points[i];
-        }
-
-        Mat totals;
-        reduce(mask, totals, 0, REDUCE_SUM);
-
-        Mat masksum;
-        reduce(contour.mask, masksum, 0, REDUCE_SUM);
-        Mat means = totals / masksum;
+        /* the mean row of the outline in each column, straight from
+         * the contour's column profile */
+        const std::vector<float> &means = contour.columnMeans;
 
         int step = self.samplingStep;
-        int start = ((means.total() - 1) % step) / 2;
+        int start = ((means.size() - 1) % step) / 2;
 
-        for (int x = start; x < means.total(); x += step) {
-            float meanValue = means.at<float>(x);
+        for (int x = start; x < means.size(); x += step) {
+            float meanValue = means[x];
             Point2d point = Point2d(x + contour.bounds.origin.x, meanValue + contour.bounds.origin.y);
             contourPoints.push_back(point);
         }
@@ -1,18 +1,57 @@
 #import <UIKit/UIKit.h>
 
+namespace remap { struct ImageView; struct ConstImageView; }
+
 typedef NS_OPTIONS(NSUInteger, DewarpOutput) {
     DewarpOutputNone                    = 0,        // <- does nothing, returns input image
     DewarpOutputDewarped                = 1 << 0,   // <- returns a dewarped image
     DewarpOutputVerticalQuadraticCurves = 1 << 1,   // <- returns the input image with debugging overlays
-    DewarpOutputVerticalCenterLines     = 1 << 2    // <- returns the input image with debugging overlays
+    DewarpOutputVerticalCenterLines     = 1 << 2,   // <- returns the input image with debugging overlays
+    DewarpOutputBilinear                = 1 << 3    // <- samples the dewarped image bilinearly instead of nearest
 };
 
 @interface DisparityModel: NSObject
 @property (nonatomic, assign, readonly) std::vector<std::vector<cv::Point2d>> keyPoints;
 @property (nonatomic, strong, readonly) UIImage *_Nonnull inputImage;
+/// the number of heap allocations made by the disparity pipeline during the last call to `apply:`.
+/// all of its scratch comes from an arena kept per thread, so this drops to zero once a page of
+/// the same size has been dewarped on the thread. the output image itself is not counted.
+@property (nonatomic, assign, readonly) NSUInteger allocationCount;
+/// the number of bytes those allocations requested
+@property (nonatomic, assign, readonly) NSUInteger bytesAllocated;
+/// whether `apply:` also corrects the horizontal disparity found from the left and right margins.
+/// both corrections are applied in the same resampling pass. defaults to YES.
+@property (nonatomic, assign) BOOL horizontalCorrection;
 
 - (instancetype _Nonnull)init NS_UNAVAILABLE;
 - (instancetype _Nonnull)initWithImage:(UIImage *_Nonnull)image keyPoints:(std::vector<std::vector<cv::Point2d>>)keyPoints NS_DESIGNATED_INITIALIZER;
+/// creates a model for `image` from one written by `exportModelToPath:`, memory mapping the file.
+/// nothing is fitted: `apply:` warps with the stored disparities, so `image` should be taken
+/// from the same rig position. returns nil if the file can't be read.
+- (instancetype _Nullable)initWithImage:(UIImage *_Nonnull)image modelPath:(NSString *_Nonnull)path;
 - (UIImage *_Nullable)apply;
 - (UIImage *_Nullable)apply:(DewarpOutput)options;
+/// fits the model to `inputImage` as usual and applies it to `image`, which must show the same
+/// page at any resolution (typically the original capture that `inputImage` was downsized from).
+/// the sampled disparities and their grid spacing are scaled to `image`, so it is resampled once,
+/// at full resolution. debugging overlays are only drawn when `image` has the size of `inputImage`.
+- (UIImage *_Nullable)apply:(DewarpOutput)options toImage:(UIImage *_Nonnull)image;
+/// like `apply:toImage:`, but reads the page from `src` and writes the dewarped page into `dst`,
+/// both owned by the caller (a camera buffer, an encoder's input). nothing is copied on the way:
+/// the pixels are converted to the format of `dst` as its rows are written, and either view may
+/// have padded rows. `dst` must have the size of `src`; only `DewarpOutputBilinear` is honoured.
+/// returns NO if there is no disparity to apply or the views don't match, leaving `dst` as is.
+- (BOOL)dewarpView:(const remap::ConstImageView *_Nonnull)src
+          intoView:(const remap::ImageView *_Nonnull)dst
+           options:(DewarpOutput)options;
+
+/// writes the fitted model (sampled disparities, fit coefficients and image geometry) to `path`
+/// in a compact binary format that `initWithImage:modelPath:` maps back in.
+- (BOOL)exportModelToPath:(NSString *_Nonnull)path;
+/// cheap check that a loaded model still fits the page: warps up to `maxLines` of the detected
+/// text lines in `keyPoints` (pixels of the model's image) and returns YES if their mean rms
+/// distance from flat is within `tolerance` pixels. always NO for a model that wasn't loaded.
+- (BOOL)validateModelWithKeyPoints:(std::vector<std::vector<cv::Point2d>>)keyPoints
+                          maxLines:(NSUInteger)maxLines
+                         tolerance:(double)tolerance;
 @end
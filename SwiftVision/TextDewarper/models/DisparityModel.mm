@@ -1,21 +1,88 @@
 #import <opencv2/opencv.hpp>
 #import "DisparityModel.h"
+#import "DisparityModel+internal.h"
 // extras
 #import "UIImage+Mat.h"
 #import "math.hpp"
+#import "polyfit.hpp"
+#import "remap.hpp"
 #import "dewarp.hpp"
+#import "sorting.hpp"
+#import "Arena.hpp"
+#import "DewarpModel.hpp"
 
 using namespace cv;
 
+/* spacing of the sampled disparity grids, in pixels of the input image */
+static const int DISPARITY_SAMPLING = 20;
+
+/* Scratch memory for the whole disparity pipeline.  Every call that
+ * uses it rewinds it to its mark on entry before returning, never past
+ * it, so calls nest and one arena per thread serves all models.  A
+ * batch of pages dewarped on one thread only goes to the heap while
+ * the pages keep getting larger. */
+static Arena *scratchArena() {
+    static thread_local Arena arena;
+    return &arena;
+}
+
+/* A zeroed w x h field in arena memory, with rows padded like an owned
+ * field's.  It is a view: it stays valid until the arena is rewound past
+ * it, and nothing needs to free it. */
+static fieldD arenaField(Arena *arena, int w, int h) {
+    size_t stride, bytes;
+    double *data;
+
+    stride = ((size_t)w * sizeof(double) + fieldD::ALIGNMENT - 1) / fieldD::ALIGNMENT * fieldD::ALIGNMENT / sizeof(double);
+    bytes = stride * h * sizeof(double);
+    if (w <= 0 || h <= 0 || (data = (double *)arena->allocate(bytes, fieldD::ALIGNMENT)) == NULL)
+        return fieldD();
+    memset(data, 0, bytes);
+    return fieldD(data, w, h, (int)stride);
+}
+
+/* A copy of src in arena memory */
+static fieldD arenaCopy(Arena *arena, const fieldD &src) {
+    fieldD field = arenaField(arena, src.width(), src.height());
+    for (int i = 0; i < field.height(); i++)
+        memcpy(field.row(i), src.row(i), (size_t)field.width() * sizeof(double));
+    return field;
+}
+
+@interface DisparityModel () {
+    // the key points as text lines, converted once
+    vvectorPointD _lines;
+}
+// scratch memory for the whole disparity pipeline, shared by the models on a thread
+@property (nonatomic, readonly) Arena *arena;
+// a fitted model to apply instead of fitting one, from initWithImage:modelPath: or initWithImage:fittedModel:
+@property (nonatomic, assign) DewarpModel *model;
+@end
+
 @implementation DisparityModel
 - (instancetype)initWithImage:(UIImage *)image keyPoints:(std::vector<vector<Point2d>>)keyPoints {
     self = [super init];
     _inputImage = image;
     _keyPoints = keyPoints;
+    [self convertKeypoints:_keyPoints into:&_lines];
+    _horizontalCorrection = YES;
+    return self;
+}
+
+- (instancetype)initWithImage:(UIImage *)image modelPath:(NSString *)path {
+    self = [self initWithImage:image keyPoints:std::vector<vector<Point2d>>()];
+    _model = new DewarpModel();
+    if (_model->load(path.fileSystemRepresentation))
+        return nil;
     return self;
 }
 
 - (void)dealloc {
+    delete _model;
+}
+
+- (Arena *)arena {
+    return scratchArena();
 }
 
 - (UIImage *_Nullable)apply {
@@ -23,23 +90,20 @@ using namespace cv;
 }
 
 - (UIImage *_Nullable)apply:(DewarpOutput)options {
-    Mat inImage = [self.inputImage mat];
-    Mat outImage = inImage.clone();
-
-    DSize inSize = (DSize){
-        .width = (double)inImage.cols,
-        .height = (double)inImage.rows
-    };
-    vvectorPointD *txtLinePts = [self convertKeypoints:self.keyPoints];
-    int w, h, d, i, j;
-    int sampling = 20;
-    int grayin = -1;
-    d = inImage.channels();
-    w = inSize.width;
-    h = inSize.height;
+    return [self apply:options toImage:self.inputImage];
+}
+
+- (UIImage *_Nullable)apply:(DewarpOutput)options toImage:(UIImage *)image {
+    Mat inImage = [image mat];
+    Mat outImage;
+    Arena *arena = self.arena;
+    size_t mark, nallocs, nbytes;
+    fieldD vDisparity, hDisparity;
+    double xsampling, ysampling;
+    BOOL fitted;
 
     /**
-     * Debugging output
+     * Debugging output, only collected when it is drawn
      */
     vvectorPointD *vQuadraticCurvePoints = NULL;
     vectorPointD *vCurveCenterPoints = NULL;
@@ -47,86 +111,252 @@ using namespace cv;
 
     /**
      * apply the vertical disparity map
+     *
+     * Every temporary of the fit, the sampled disparities and the
+     * remap's scratch come from the arena, which is rewound to where
+     * it was on entry once the image is written.  The arena keeps its
+     * memory, so after the first call none of this touches the heap.
      **/
-    vvectorD *vDisparity = [self getVerticalDisparity:txtLinePts
-                                       inputImageSize:inSize
-                                     samplinginterval:sampling
-                                 quadraticCurvePoints:&vQuadraticCurvePoints
-                                    curveCenterPoints:&vCurveCenterPoints];
-    int isrc;
-    for(i = 0; i < h && (options & DewarpOutputDewarped); i++) {
-        int wpl = w * d;
-
-        for(j = 0; j < wpl; j++) {
-            isrc = (int)(i - vDisparity->at(i).at(j/d) + 0.5);
-
-            if (grayin < 0)
-                isrc = min(max(isrc, 0), h - 1);
-            if (isrc >= 0 && isrc < h){
-                unsigned char *rowPtr = inImage.ptr(isrc);
-                outImage.at<unsigned char>(i, j) = rowPtr[j];
-            }
-        }
-    }
+    mark = arena->mark();
+    nallocs = arena->allocationCount();
+    nbytes = arena->bytesAllocated();
+    fitted = [self disparitiesForWidth:inImage.cols
+                                height:inImage.rows
+                               options:options
+                              vertical:&vDisparity
+                            horizontal:&hDisparity
+                             xsampling:&xsampling
+                             ysampling:&ysampling
+                  quadraticCurvePoints:(options & DewarpOutputVerticalQuadraticCurves) ? &vQuadraticCurvePoints : NULL
+                     curveCenterPoints:(options & DewarpOutputVerticalCenterLines) ? &vCurveCenterPoints : NULL];
+
+    /* Warp straight from the sampled disparities; each output pixel is
+     * resampled once, with the full resolution maps interpolated row
+     * by row as the output is written. */
+    if ((options & DewarpOutputDewarped) && fitted) {
+        outImage.create(inImage.rows, inImage.cols, inImage.type());
+        remap::applyDisparity(inImage.data, inImage.cols, inImage.rows, inImage.channels(), (int)inImage.step,
+                              &vDisparity, hDisparity.empty() ? NULL : &hDisparity,
+                              xsampling, ysampling, arena,
+                              outImage.data, (int)outImage.step,
+                              (options & DewarpOutputBilinear) ? remap::REMAP_BILINEAR : remap::REMAP_NEAREST);
+    } else {
+        outImage = inImage.clone();
+    }
+
+    /* the views go before the memory they look into */
+    vDisparity = fieldD();
+    hDisparity = fieldD();
+    arena->release(mark);
+    _allocationCount = arena->allocationCount() - nallocs;
+    _bytesAllocated = arena->bytesAllocated() - nbytes;
 
     [self debugVerticals:outImage
-    quadraticCurvePoints:(options & DewarpOutputVerticalQuadraticCurves) ? vQuadraticCurvePoints : NULL
-       curveCenterPoints:(options & DewarpOutputVerticalCenterLines) ? vCurveCenterPoints : NULL];
+    quadraticCurvePoints:vQuadraticCurvePoints
+       curveCenterPoints:vCurveCenterPoints];
 
     return [[UIImage alloc] initWithCVMat:outImage];
 }
 
-- (vvectorPointD *)convertKeypoints:(std::vector<vector<Point2d>>)keyPoints {
-    vvectorPointD *ptaa = new vvectorPointD();
-    for (int v = 0; v < keyPoints.size(); v++) {
-        std::vector<Point2d> ps = keyPoints.at(v);
-        vectorPointD *pta = new vectorPointD();
-        for (int c = 0; c < ps.size(); c++) {
-            Point2d p = ps.at(c);
-            DPoint pt = (DPoint){ .x = p.x, .y = p.y };
-            pta->push_back(pt);
+- (BOOL)dewarpView:(const remap::ConstImageView *)src
+          intoView:(const remap::ImageView *)dst
+           options:(DewarpOutput)options {
+    Arena *arena = self.arena;
+    size_t mark, nallocs, nbytes;
+    fieldD vDisparity, hDisparity;
+    double xsampling, ysampling;
+    int ret = 1;
+
+    if (!src || !dst)
+        return NO;
+
+    /* Same pipeline as apply:toImage:, but the pixels never pass
+     * through a Mat: the remap reads the caller's rows and writes the
+     * caller's buffer, converting the format as each row is written. */
+    mark = arena->mark();
+    nallocs = arena->allocationCount();
+    nbytes = arena->bytesAllocated();
+    if ([self disparitiesForWidth:src->width
+                           height:src->height
+                          options:options | DewarpOutputDewarped
+                         vertical:&vDisparity
+                       horizontal:&hDisparity
+                        xsampling:&xsampling
+                        ysampling:&ysampling
+             quadraticCurvePoints:NULL
+                curveCenterPoints:NULL])
+        ret = remap::applyDisparity(src, &vDisparity, hDisparity.empty() ? NULL : &hDisparity,
+                                    xsampling, ysampling, arena, dst,
+                                    (options & DewarpOutputBilinear) ? remap::REMAP_BILINEAR : remap::REMAP_NEAREST);
+
+    vDisparity = fieldD();
+    hDisparity = fieldD();
+    arena->release(mark);
+    _allocationCount = arena->allocationCount() - nallocs;
+    _bytesAllocated = arena->bytesAllocated() - nbytes;
+    return ret == 0;
+}
+
+/// the size of `inputImage` in pixels of its Mat, the image the fit is applied to. its size
+/// in points can be fractional, and would then never match the Mat's columns and rows.
+- (DSize)inputSize {
+    cv::Size size = [self.inputImage matSize];
+    return (DSize){ .width = (double)size.width, .height = (double)size.height };
+}
+
+/// the sampled disparities for a `w` x `h` image of the page, as views into the arena, and the
+/// spacing of their grid in pixels of that image. they come from the fit to `inputImage`, or
+/// from the loaded model, scaled by the size of the image. `hDisparity` is left empty without
+/// horizontal correction, and the debugging points are only collected at the fitted size.
+/// returns NO if there is no vertical disparity.
+- (BOOL)disparitiesForWidth:(int)w
+                     height:(int)h
+                    options:(DewarpOutput)options
+                   vertical:(fieldD *)vDisparity
+                 horizontal:(fieldD *)hDisparity
+                  xsampling:(double *)pxsampling
+                  ysampling:(double *)pysampling
+       quadraticCurvePoints:(vvectorPointD **)quadraticCurvePoints
+          curveCenterPoints:(vectorPointD **)curveCenterPoints {
+    /* the model is always fitted at the size of the input image */
+    DSize inSize = [self inputSize];
+    Arena *arena = self.arena;
+    int sampling = DISPARITY_SAMPLING;
+    double sx, sy;
+    BOOL debug;
+    if (self.model) {
+        inSize = (DSize){ .width = (double)self.model->width, .height = (double)self.model->height };
+        sampling = self.model->sampling;
+    }
+    sx = w / inSize.width;
+    sy = h / inSize.height;
+    debug = (sx == 1.0 && sy == 1.0);
+
+    if (self.model) {
+        /* reuse the loaded fit; the copies are rescaled below */
+        *vDisparity = arenaCopy(arena, self.model->vertical);
+        if (self.horizontalCorrection && !self.model->horizontal.empty())
+            *hDisparity = arenaCopy(arena, self.model->horizontal);
+    } else {
+        [self getVerticalDisparity:&_lines
+                    inputImageSize:inSize
+                  samplinginterval:sampling
+              quadraticCurvePoints:debug ? quadraticCurvePoints : NULL
+                 curveCenterPoints:debug ? curveCenterPoints : NULL
+                        columnFits:NULL
+                         disparity:vDisparity];
+
+        /**
+         * and the horizontal one, sampled on the same grid
+         **/
+        if ((options & DewarpOutputDewarped) && self.horizontalCorrection)
+            [self getHorizontalDisparity:&_lines
+                          inputImageSize:inSize
+                        samplinginterval:sampling
+                               disparity:hDisparity];
+    }
+    if (vDisparity->empty())
+        return NO;
+
+    /* For a larger image the disparities (in pixels) and the grid
+     * spacing both grow by the image scale, which need not be an
+     * integer. */
+    if (sy != 1.0)
+        dewarp::addMultConstant(vDisparity, 0.0, sy);
+    if (!hDisparity->empty() && sx != 1.0)
+        dewarp::addMultConstant(hDisparity, 0.0, sx);
+    *pxsampling = sampling * sx;
+    *pysampling = sampling * sy;
+    return YES;
+}
+
+- (instancetype)initWithImage:(UIImage *)image fittedModel:(DewarpModel *)model {
+    self = [self initWithImage:image keyPoints:std::vector<vector<Point2d>>()];
+    _model = model;
+    return self;
+}
+
+- (DewarpModel *)fitModel {
+    DewarpModel *model = new DewarpModel();
+    DSize inSize = [self inputSize];
+    int sampling = DISPARITY_SAMPLING;
+    double margins[6];
+    ArenaScope scope(self.arena);
+    fieldD vDisparity, hDisparity;
+
+    model->width = (int)inSize.width;
+    model->height = (int)inSize.height;
+    model->sampling = sampling;
+    if ([self getVerticalDisparity:&_lines
+                    inputImageSize:inSize
+                  samplinginterval:sampling
+              quadraticCurvePoints:NULL
+                 curveCenterPoints:NULL
+                        columnFits:&model->columnFits
+                         disparity:&vDisparity])
+        model->vertical.copyFrom(vDisparity);
+    if ([self getHorizontalDisparity:&_lines
+                      inputImageSize:inSize
+                    samplinginterval:sampling
+                quadraticCurvePoints:NULL
+                quadraticCurvePoints:NULL
+                   leftLineEndPoints:NULL
+                  rightLineEndPoints:NULL
+                          leftBounds:NULL
+                         rightBounds:NULL
+                          marginFits:margins
+                           disparity:&hDisparity]) {
+        model->horizontal.copyFrom(hDisparity);
+        for (int i = 0; i < 3; i++) {
+            model->leftMargin[i] = margins[i];
+            model->rightMargin[i] = margins[3 + i];
         }
-        ptaa->push_back(*pta);
     }
-    return ptaa;
+    return model;
 }
 
-- (vvectorD *)scaleDisparity:(vvectorD *)disparity
-              inputImageSize:(DSize)inSize
-            samplingInterval:(int)sampling {
+- (BOOL)exportModelToPath:(NSString *)path {
+    if (self.model)
+        return self.model->save(path.fileSystemRepresentation) == 0;
 
-    vvectorD *fulldisparity;
-    vvectorD *fpixt1, *fpixt2;
-    int deltaw, deltah, redfactor;
-    int nx, ny;
+    DewarpModel *model = [self fitModel];
+    BOOL saved = model->save(path.fileSystemRepresentation) == 0;
+    delete model;
+    return saved;
+}
 
-    /* Find the required width and height expansion deltas */
-    redfactor = 1;
-    nx = (inSize.width + 2 * sampling - 2) / sampling;      // number of sampling pts in x-dir
-    ny = (inSize.height + 2 * sampling - 2) / sampling;     // number of sampling pts in y-dir
-    deltaw = inSize.width - sampling * (nx - 1) + 2;
-    deltah = inSize.height - sampling * (ny - 1) + 2;
-    deltaw = redfactor * max(0, deltaw);
-    deltah = redfactor * max(0, deltah);
-
-    /* Generate the full res vertical array if it doesn't exist,
-     * extending it as required to make it big enough.  Use x,y
-     * to determine the amounts on each side. */
-    fpixt1 = new vvectorD(*disparity);
-    if (redfactor == 2)
-        dewarp::addMultConstant(fpixt1, 0.0, (double)redfactor);
-
-    fpixt2 = dewarp::scaleByInteger(fpixt1, sampling * redfactor);
-    fulldisparity = new vvectorD(*fpixt2);
-    free(fpixt1);
-    free(fpixt2);
-
-    return fulldisparity;
+- (BOOL)validateModelWithKeyPoints:(std::vector<std::vector<cv::Point2d>>)keyPoints
+                          maxLines:(NSUInteger)maxLines
+                         tolerance:(double)tolerance {
+    vvectorPointD lines;
+    double mean;
+
+    if (!self.model)
+        return NO;
+    [self convertKeypoints:keyPoints into:&lines];
+    return !self.model->flatness(&lines, (int)maxLines, &mean, NULL) && mean <= tolerance;
+}
+
+/// converts the key points to text lines, each built in place in `lines`.
+- (void)convertKeypoints:(const std::vector<vector<Point2d>> &)keyPoints into:(vvectorPointD *)lines {
+    lines->clear();
+    lines->reserve(keyPoints.size());
+    for (size_t v = 0; v < keyPoints.size(); v++) {
+        const std::vector<Point2d> &ps = keyPoints[v];
+        lines->push_back(vectorPointD());
+        vectorPointD &pta = lines->back();
+        pta.reserve(ps.size());
+        for (size_t c = 0; c < ps.size(); c++)
+            pta.push_back((DPoint){ .x = ps[c].x, .y = ps[c].y });
+    }
 }
 
-- (vvectorD *)getHorizontalDisparity:(vvectorPointD *)keypoints
-                      inputImageSize:(DSize)inSize
-                    samplinginterval:(int)sampling {
+/// writes the horizontal disparity, sampled every `sampling` pixels, to `hdisparity` as a view
+/// into the arena; returns NO, leaving it empty, if the margins could not be fitted.
+- (BOOL)getHorizontalDisparity:(const vvectorPointD *)keypoints
+                inputImageSize:(DSize)inSize
+              samplinginterval:(int)sampling
+                     disparity:(fieldD *)hdisparity {
     return [self getHorizontalDisparity:keypoints
                          inputImageSize:inSize
                        samplinginterval:sampling
@@ -135,202 +365,160 @@ using namespace cv;
                       leftLineEndPoints:NULL
                      rightLineEndPoints:NULL
                              leftBounds:NULL
-                            rightBounds:NULL];
+                            rightBounds:NULL
+                             marginFits:NULL
+                              disparity:hdisparity];
 }
 
-- (vvectorD *)getHorizontalDisparity:(vvectorPointD *)keypoints
-                      inputImageSize:(DSize)inSize
-                    samplinginterval:(int)sampling
-                quadraticCurvePoints:(vectorPointD **)leftQuadraticCurvePoints
-                quadraticCurvePoints:(vectorPointD **)rightQuadraticCurvePoints
-                   leftLineEndPoints:(vectorPointD **)leftLineEndPoints
-                  rightLineEndPoints:(vectorPointD **)rightLineEndPoints
-                          leftBounds:(double *)leftBounds
-                         rightBounds:(double *)rightBounds {
-
-    vectorPointD *ptal1, *ptar1;  /* left/right end points of lines; initial */
-    vectorPointD *ptal2, *ptar2;  /* left/right end points; after filtering */
-    vectorPointD *ptal3, *ptar3;  /* left and right block, fitted, uniform spacing */
-    vectorPointD *pptal, *pptar;
-    vectorD *nald, *nard;
-    double val, c1, c0;
-    int n, i, j;
+/// the debugging outputs, if requested, are allocated on the heap and owned by the caller.
+- (BOOL)getHorizontalDisparity:(const vvectorPointD *)keypoints
+                inputImageSize:(DSize)inSize
+              samplinginterval:(int)sampling
+          quadraticCurvePoints:(vectorPointD **)leftQuadraticCurvePoints
+          quadraticCurvePoints:(vectorPointD **)rightQuadraticCurvePoints
+             leftLineEndPoints:(vectorPointD **)leftLineEndPoints
+            rightLineEndPoints:(vectorPointD **)rightLineEndPoints
+                    leftBounds:(double *)leftBounds
+                   rightBounds:(double *)rightBounds
+                    marginFits:(double *)marginFits
+                     disparity:(fieldD *)hdisparity {
+
+    DPoint *ptal, *ptar;          /* left/right end points of lines, transposed */
+    double *samplel, *sampler;    /* left and right margins, fitted, uniform spacing in y */
+    double cl[3], cr[3];
+    double refl, refr;
+    int n, m, i;
     int nx, ny;
 
     nx = (inSize.width + 2 * sampling - 2) / sampling;     // number of sampling pts in x-dir
     ny = (inSize.height + 2 * sampling - 2) / sampling;     // number of sampling pts in y-dir
     n = (int)keypoints->size();
-    ptal1 = new vectorPointD();
-    ptar1 = new vectorPointD();
+
+    /* The disparity is allocated first, so it outlives the scratch
+     * rewound on return */
+    Arena *arena = self.arena;
+    *hdisparity = arenaField(arena, nx, ny);
+    ArenaScope scope(arena);
 
     /* Extract the line end points, and transpose x and y values */
-    for (i = 0; i < n; i++) {
-        vectorPointD *pta = new vectorPointD((*keypoints)[i]);
-        DPoint p1 = pta->at(0);
-        DPoint tp1 = (DPoint){ .x = p1.y, .y = p1.x};  /* transpose */
-        ptal1->push_back(tp1);
-
-        int npt = (int)pta->size();
-        DPoint p2 = pta->at(npt-1);
-        DPoint tp2 = (DPoint){ .x = p2.y, .y = p2.x};  /* transpose */
-        ptar1->push_back(tp2);
-
-        free(pta);
+    ptal = arena->alloc<DPoint>(n + 1);
+    ptar = arena->alloc<DPoint>(n + 1);
+    for (m = 0, i = 0; i < n; i++) {
+        const vectorPointD &pta = (*keypoints)[i];
+        if (pta.empty())
+            continue;
+        ptal[m] = (DPoint){ .x = pta.front().y, .y = pta.front().x };
+        ptar[m] = (DPoint){ .x = pta.back().y, .y = pta.back().x };
+        m++;
     }
 
-    if (leftLineEndPoints) {
-        *leftLineEndPoints = NULL;
-        *leftLineEndPoints = new vectorPointD(*ptal1);
-    }
-    if (rightLineEndPoints) {
-        *rightLineEndPoints = NULL;
-        *rightLineEndPoints = new vectorPointD(*ptar1);
-    }
+    if (leftLineEndPoints)
+        *leftLineEndPoints = new vectorPointD(ptal, ptal + m);
+    if (rightLineEndPoints)
+        *rightLineEndPoints = new vectorPointD(ptar, ptar + m);
 
     /*
      * TODO: Use the min and max of the y value on the left side!
      */
 
-    /* Sort from top to bottom */
-    pptal = dewarp::sort(ptal1, L_SORT_BY_X, L_SORT_INCREASING, NULL);
-    pptar = dewarp::sort(ptar1, L_SORT_BY_X, L_SORT_INCREASING, NULL);
-
-    /* Filter the points by x-location to prevent 2-column images
-     * from getting confused about left and right endpoints. We
-     * require valid left points to not be farther than
-     *     0.20 * (remaining distance to the right edge of the image)
-     * to the right of the leftmost endpoint, and similarly for
-     * the right endpoints. (Note: x and y are reversed in the pta.)
-     * Also require end points to be near the medians in the
-     * upper and lower halves. */
-    //ret = dewarpFilterLineEndPoints(dew, ptal1, ptar1, &ptal2, &ptar2);
-    ptal2 = new vectorPointD(*ptal1);
-    ptar2 = new vectorPointD(*ptar1);
-    free(ptal1);
-    free(ptar1);
-
-    /* Do a quadratic fit to the left and right endpoints of the
-     * longest lines.  Each line is represented by 3 coefficients:
+    /* Fit the end points of both margins in one pass.
+     * A plain quadratic fit lets a single heading, page number or
+     * short last line bend the whole margin, so each margin is fitted
+     * robustly (IRLS with Tukey's biweight, starting from the median
+     * column).  Each margin is represented by 3 coefficients:
      *     x(y) = c2 * y^2 + c1 * y + c0.
-     * Using the coefficients, sample each fitted curve uniformly
-     * along the full height of the image. */
-    double mederr, cl0, cl1, cl2, cr0, cr1, cr2;
-    double x, y, refl, refr;
-
-    math::dewarpQuadraticLSF(ptal2, &cl2, &cl1, &cl0, &mederr);
-    ptal3 = new vectorPointD();
-    for (i = 0; i < ny; i++) {  /* uniformly sampled in y */
-        y = i * sampling;
-        math::applyQuadraticFit(cl2, cl1, cl0, y, &x);
-        DPoint cp = (DPoint){.x = x, .y = y};
-        ptal3->push_back(cp);
-    }
-    if (leftQuadraticCurvePoints) {
-        *leftQuadraticCurvePoints = NULL;
-        *leftQuadraticCurvePoints = new vectorPointD(*ptal3);
+     * (Note: x and y are reversed in the pta.)  Using the coefficients,
+     * sample each fitted curve uniformly along the full height of
+     * the image. */
+    if (hdisparity->empty() || math::dewarpRobustMarginLSF(ptal, m, ptar, m, 10, arena, cl, cr, NULL)) {
+        *hdisparity = fieldD();
+        return NO;
+    }
+    if (marginFits) {
+        for (i = 0; i < 3; i++) {
+            marginFits[i] = cl[i];
+            marginFits[3 + i] = cr[i];
+        }
     }
 
-    /* Fit the right side in the same way. */
-    math::dewarpQuadraticLSF(ptar2, &cr2, &cr1, &cr0, &mederr);
-    ptar3 = new vectorPointD();
-    for (i = 0; i < ny; i++) {  /* uniformly sampled in y */
-        y = i * sampling;
-        math::applyQuadraticFit(cr2, cr1, cr0, y, &x);
-        DPoint cp = (DPoint){.x = x, .y = y};
-        ptar3->push_back(cp);
+    samplel = arena->alloc<double>(ny);
+    sampler = arena->alloc<double>(ny);
+    PolyFit<2>::fromCoefficients(cl).evaluateGrid(0.0, sampling, ny, samplel);
+    PolyFit<2>::fromCoefficients(cr).evaluateGrid(0.0, sampling, ny, sampler);
+    if (leftQuadraticCurvePoints) {
+        *leftQuadraticCurvePoints = new vectorPointD();
+        for (i = 0; i < ny; i++)  /* uniformly sampled in y */
+            (*leftQuadraticCurvePoints)->push_back((DPoint){.x = samplel[i], .y = (double)(i * sampling)});
     }
     if (rightQuadraticCurvePoints) {
-        *rightQuadraticCurvePoints = NULL;
-        *rightQuadraticCurvePoints = new vectorPointD(*ptar3);
-    }
-
-    /* Find the x value at the midpoints (in y) of the two vertical lines,
-     * ptal3 and ptar3.  These are the reference values for each of the
-     * lines.  Then use the difference between the these midpoint
-     * values and the actual x coordinates of the lines to represent
-     * the horizontal disparity (nald, nard) on the vertical lines
-     * for the sampled y values. */
-    refl = ptal3->at(ny/2).x;
-    refr = ptar3->at(ny/2).x;
-    nald = new std::vector<double>();
-    nard = new std::vector<double>();
-    for (i = 0; i < ny; i++) {
-        DPoint pl = ptal3->at(i);
-        nald->push_back(refl-pl.x);
-
-        DPoint pr = ptar3->at(i);
-        nard->push_back(refr-pr.x);
-    }
-    if (leftBounds) {
-        *leftBounds = NULL;
+        *rightQuadraticCurvePoints = new vectorPointD();
+        for (i = 0; i < ny; i++)
+            (*rightQuadraticCurvePoints)->push_back((DPoint){.x = sampler[i], .y = (double)(i * sampling)});
+    }
+
+    /* Find the x value at the midpoints (in y) of the two margins.
+     * These are the reference values for each of the lines.  Then use
+     * the difference between the these midpoint values and the actual
+     * x coordinates of the margins to represent the horizontal
+     * disparity on them for the sampled y values. */
+    refl = samplel[ny/2];
+    refr = sampler[ny/2];
+    if (leftBounds)
         *leftBounds = refl;
-    }
-    if (rightBounds) {
-        *rightBounds = NULL;
+    if (rightBounds)
         *rightBounds = refr;
-    }
 
-    /* Now for each pair of sampled values of the two lines (at the
-     * same value of y), do a linear interpolation to generate
-     * the horizontal disparity on all sampled points between them.  */
-    vvectorPointD *ptaah = new vvectorPointD();
+    /* Now for each pair of sampled values of the two margins (at the
+     * same value of y), do a linear interpolation to generate the
+     * horizontal disparity on all sampled points between them, written
+     * straight into the rows of the field. */
+    int *offsets = arena->alloc<int>(ny + 1);
+    double *xs = arena->alloc<double>(2 * ny);
+    double *ys = arena->alloc<double>(2 * ny);
+    double *ca1 = arena->alloc<double>(ny);
+    double *ca0 = arena->alloc<double>(ny);
     for (i = 0; i < ny; i++) {
-        vectorPointD *pta = new vectorPointD();
-        val = nald->at(i);
-        pta->push_back((DPoint){.x = refl, .y = val});
-        val = nard->at(i);
-        pta->push_back((DPoint){.x = refr, .y = val});
-
-        math::getLinearLSF(pta, &c1, &c0, NULL);  /* horiz disparity along line */
-        vectorPointD *ptat = new vectorPointD();
-        for (j = 0; j < nx; j++) {
-            x = j * sampling;
-            math::applyLinearFit(c1, c0, x, &val);
-            ptat->push_back((DPoint){.x = x, .y = val});
-        }
-        ptaah->push_back(*ptat);
-        free(pta);
+        offsets[i] = 2 * i;
+        xs[2 * i] = refl;
+        ys[2 * i] = refl - samplel[i];
+        xs[2 * i + 1] = refr;
+        ys[2 * i + 1] = refr - sampler[i];
     }
-    free(nald);
-    free(nard);
+    offsets[ny] = 2 * ny;
+    math::getLinearLSFBatch(xs, ys, offsets, ny, ca1, ca0, NULL);  /* horiz disparity along line */
 
-    vvectorD *hdisparity = new vvectorD(ny, vectorD(nx, 0));
     for (i = 0; i < ny; i++) {
-        for (j = 0; j < nx; j++) {
-            hdisparity->at(i).at(j) = ptaah->at(i).at(j).y;
-        }
+        double cl[2] = { ca1[i], ca0[i] };
+        PolyFit<1>::fromCoefficients(cl).evaluateGrid(0.0, sampling, nx, hdisparity->row(i));
     }
-
-    free(ptal2);
-    free(ptar2);
-    free(ptal3);
-    free(ptar3);
-    free(ptaah);
-
-    return [self scaleDisparity:hdisparity inputImageSize:inSize samplingInterval:sampling];
+    return YES;
 }
 
-- (vvectorD *)getVerticalDisparity:(vvectorPointD *)keypoints
-                    inputImageSize:(DSize)inSize
-                  samplinginterval:(int)sampling {
-    return [self getHorizontalDisparity:keypoints
-                         inputImageSize:inSize
-                       samplinginterval:sampling
-                   quadraticCurvePoints:NULL
-                   quadraticCurvePoints:NULL
-                      leftLineEndPoints:NULL
-                     rightLineEndPoints:NULL
-                             leftBounds:NULL
-                            rightBounds:NULL];
+/// writes the vertical disparity, sampled every `sampling` pixels, to `vdisparity` as a view
+/// into the arena; returns NO, leaving it empty, if there are too few lines to fit.
+- (BOOL)getVerticalDisparity:(const vvectorPointD *)keypoints
+              inputImageSize:(DSize)inSize
+            samplinginterval:(int)sampling
+                   disparity:(fieldD *)vdisparity {
+    return [self getVerticalDisparity:keypoints
+                       inputImageSize:inSize
+                     samplinginterval:sampling
+                 quadraticCurvePoints:NULL
+                    curveCenterPoints:NULL
+                           columnFits:NULL
+                            disparity:vdisparity];
 }
 
-- (vvectorD *)getVerticalDisparity:(vvectorPointD *)keypoints
-                    inputImageSize:(DSize)inSize
-                  samplinginterval:(int)sampling
-              quadraticCurvePoints:(vvectorPointD **)quadraticCurvePoints
-                 curveCenterPoints:(vectorPointD **)curveCenterPoints {
-    double val, c2, c1, c0;
-    int i, j;
+/// `columnFits`, if given, receives the c2, c1, c0 of the fit down each grid column.
+/// the debugging outputs, if requested, are allocated on the heap and owned by the caller.
+- (BOOL)getVerticalDisparity:(const vvectorPointD *)keypoints
+              inputImageSize:(DSize)inSize
+            samplinginterval:(int)sampling
+        quadraticCurvePoints:(vvectorPointD **)quadraticCurvePoints
+           curveCenterPoints:(vectorPointD **)curveCenterPoints
+                  columnFits:(fieldD *)columnFits
+                   disparity:(fieldD *)vdisparity {
+    int i, j, k;
     int nx, ny;
     int nlines;
 
@@ -338,172 +526,140 @@ using namespace cv;
     ny = (inSize.height + 2 * sampling - 2) / sampling;     // number of sampling pts in y-dir
     nlines = (int) keypoints->size();
 
-    vvectorPointD *ptaa0 = new vvectorPointD();
-    vectorD *nacurve0 = new vectorD();
-    for (i = 0; i < nlines; i++) {  // take all the vertical center points for a line
+    /* The disparity is allocated first, so it outlives the scratch
+     * rewound on return */
+    Arena *arena = self.arena;
+    *vdisparity = arenaField(arena, nx, ny);
+    ArenaScope scope(arena);
+
+    /* Lay out the points of every line with at least 3 of them in
+     * SoA form and fit all of the lines in one batch, runs of lines
+     * on separate threads. */
+    int nfits, npts;
+    int *offsets = arena->alloc<int>(nlines + 1);
+    for (nfits = 0, npts = 0, i = 0; i < nlines; i++) {
         if (keypoints->at(i).size() < 3)
             continue;
-
-        vectorPointD *pta = new vectorPointD((*keypoints)[i]);
-        math::getQuadraticLSF(pta, &c2, &c1, &c0, NULL);        // calculate the LSF
-        nacurve0->push_back(c2);                                // store the c2 coeffecient..
-        vectorPointD *ptad = new vectorPointD();                // create a point array with a size = the number of
-
-        double x, y = 0;
-        for (j = 0; j < nx; j++) {                          // samples in the horizontal direction
-            x = j * sampling;                               // keep jumping forward by the sampling value...
-            math::applyQuadraticFit(c2, c1, c0, x, &y);     // and run the quadratic fit, y is an out variable...
-            DPoint p = (DPoint){.x = x, .y = y};
-            ptad->push_back(p);                             // and store x and y in the ptad
+        offsets[nfits++] = npts;
+        npts += (int)keypoints->at(i).size();
+    }
+    offsets[nfits] = npts;
+    if (vdisparity->empty() || nfits < 3) {
+        *vdisparity = fieldD();
+        return NO;
+    }
+    double *xs = arena->alloc<double>(npts);
+    double *ys = arena->alloc<double>(npts);
+    for (npts = 0, i = 0; i < nlines; i++) {
+        if (keypoints->at(i).size() < 3)
+            continue;
+        for (j = 0; j < (int)keypoints->at(i).size(); j++, npts++) {
+            xs[npts] = (*keypoints)[i][j].x;
+            ys[npts] = (*keypoints)[i][j].y;
         }
-        ptaa0->push_back(*ptad);
-        free(ptad);
-        free(pta);
     }
-    nlines = (int) ptaa0->size();
+    double *ca2 = arena->alloc<double>(nfits);
+    double *ca1 = arena->alloc<double>(nfits);
+    double *ca0 = arena->alloc<double>(nfits);
+    math::getQuadraticLSFBatch(xs, ys, offsets, nfits, arena, ca2, ca1, ca0, NULL);
+
+    /* Sample every fit every `sampling` px in x; row i of curves is
+     * line i.  The c2 coefficients are the curvatures. */
+    double *curves = arena->alloc<double>(nfits * nx);
+    math::evaluateQuadraticRows(ca2, ca1, ca0, nfits, 0.0, sampling, nx, curves, nx);
     if (quadraticCurvePoints) {
-        *quadraticCurvePoints = NULL;
-        *quadraticCurvePoints = new vvectorPointD(*ptaa0);
+        *quadraticCurvePoints = new vvectorPointD(nfits);
+        for (i = 0; i < nfits; i++) {
+            vectorPointD &pta = (**quadraticCurvePoints)[i];
+            pta.reserve(nx);
+            for (j = 0; j < nx; j++)
+                pta.push_back((DPoint){.x = (double)(j * sampling), .y = curves[i * nx + j]});
+        }
     }
 
     /* Remove lines with outlier curvatures.
      * Note that this is just looking for internal consistency in
      * the line curvatures. */
     double medval, medvar;
-    dewarp::getMedianVariation(nacurve0, &medval, &medvar);
-    vvectorPointD *ptaa1 = new vvectorPointD();
-    vectorD *nacurve1 = new vectorD();
-
-    for (i = 0; i < nlines; i++) {  /* for each line */
-        val = nacurve0->at(i);
-        if (abs(val - medval) > 3.0 * medvar)
+    constSpanD curvatures = { ca2, nfits };
+    dewarp::getMedianVariation(curvatures, arena, &medval, &medvar);
+    int *kept = arena->alloc<int>(nfits);
+    for (nlines = 0, i = 0; i < nfits; i++) {  /* for each line */
+        if (fabs(ca2[i] - medval) > 3.0 * medvar)
             continue;
-        vectorPointD *pta = new vectorPointD((*ptaa0)[i]);
-        ptaa1->push_back(*pta);
-        nacurve1->push_back(val);
-        free(pta);
+        kept[nlines++] = i;
     }
-    nlines = (int)ptaa1->size();
-    free(nacurve0);
 
     /**
-     * TODO: calculate and store the min and max curvature (from nacurve1)
+     * TODO: calculate and store the min and max curvature of the kept lines
      *
      */
 
     /* Find and save the y values at the mid-points in each curve.
      * If the slope is zero anywhere, it will typically be here. */
-    vectorD *namidy = new vectorD();
-    vectorPointD *debugPts = new vectorPointD();
-    for (i = 0; i < nlines; i++) {
-        vectorPointD *pta = new vectorPointD((*ptaa1)[i]);
-        int npts = (int)pta->size();
-        DPoint mid = pta->at(npts/2);
-        namidy->push_back(mid.y);
-        free(pta);
-        debugPts->push_back(mid);
-    }
+    double *midys = arena->alloc<double>(nlines);
+    for (k = 0; k < nlines; k++)
+        midys[k] = curves[kept[k] * nx + nx / 2];
     if (curveCenterPoints) {
-        *curveCenterPoints = NULL;
-        *curveCenterPoints = new vectorPointD(*debugPts);
+        *curveCenterPoints = new vectorPointD();
+        for (k = 0; k < nlines; k++)
+            (*curveCenterPoints)->push_back((DPoint){.x = (double)((nx / 2) * sampling), .y = midys[k]});
     }
-    free(debugPts);
 
     /**
-     * Sort the lines in ptaa1 by their vertical position, going down
+     * Sort the kept lines by their vertical position, going down.
+     * The radix sort is stable, so lines at the same height keep
+     * their order, and its index and scratch come from the arena.
      */
-    vectorD *namidysi = dewarp::getSortIndex(namidy, L_SORT_INCREASING);
-    vectorD *namidys = dewarp::sortByIndex(namidy, namidysi);
-    vectorD *nacurves = dewarp::sortByIndex(nacurve1, namidysi);
-    vvectorPointD *ptaa2 = dewarp::sortByIndex(ptaa1, namidysi);
-    free(namidy);
-    free(nacurve1);
-    free(namidysi);
-    free(nacurves);
-
-    /* Convert the sampled points in ptaa2 to a sampled disparity with
-     * with respect to the y value at the mid point in the curve.
-     * The disparity is the distance the point needs to move;
-     * plus is downward.  */
-    vvectorPointD *ptaa3 = new vvectorPointD();
-    for (i = 0; i < nlines; i++) {
-        vectorPointD *pta = new vectorPointD((*ptaa2)[i]);
-        vectorPointD *ptad = new vectorPointD();
-        double midy = namidys->at(i);
-
-        for (j = 0; j < nx; j++) {
-            DPoint p = pta->at(j);
-            DPoint disparity = (DPoint){.x = p.x, .y = midy - p.y};
-            ptad->push_back(disparity);
-        }
-        ptaa3->push_back(*ptad);
-        free(pta);
-        free(ptad);
-    }
-
-    /* Generate ptaa4 by taking vertical 'columns' from ptaa3.
-     * We want to fit the vertical disparity on the column to the
-     * vertical position of the line, which we call 'y' here and
-     * obtain from namidys.  So each pta in ptaa4 is the set of
-     * vertical disparities down a column of points.  The columns
-     * in ptaa4 are equally spaced in x. */
-    vvectorPointD *ptaa4 = new vvectorPointD();
-    vectorD *famidys = new vectorD(*namidys);
-    for (j = 0; j < nx; j++) {
-        vectorPointD *pta = new vectorPointD();
-        for (i = 0; i < nlines; i++) {
-            double y = (*famidys)[i];
-            DPoint p = (*ptaa3)[i][j];
-            DPoint op = (DPoint){.x = y, .y = p.y};
-            pta->push_back(op);
-        }
-        ptaa4->push_back(*pta);
-        free(pta);
-    }
-    free(namidys);
-
-    /* Do quadratic fit vertically on each of the pixel columns
-     * in ptaa4, for the vertical displacement (which identifies the
+    uint32_t *order = arena->alloc<uint32_t>(nlines);
+    uint32_t *scratch = arena->alloc<uint32_t>(nlines);
+    if (sorting::radixSortIndex(midys, nlines, 1, L_SORT_INCREASING, order, scratch)) {
+        *vdisparity = fieldD();
+        return NO;
+    }
+
+    /* Convert the sampled curves to a sampled disparity with respect
+     * to the y value at the mid point in the curve.  The disparity is
+     * the distance the point needs to move; plus is downward.  Row k
+     * of the table holds the k-th line from the top, so each column
+     * is the set of vertical disparities down a column of points; the
+     * columns are equally spaced in x. */
+    double *namidys = arena->alloc<double>(nlines);
+    double *disparities = arena->alloc<double>(nlines * nx);
+    for (k = 0; k < nlines; k++) {
+        const double *curve = curves + kept[order[k]] * nx;
+        double midy = midys[order[k]];
+        namidys[k] = midy;
+        for (j = 0; j < nx; j++)
+            disparities[k * nx + j] = midy - curve[j];
+    }
+
+    /* Do quadratic fit vertically on each of the pixel columns,
+     * for the vertical displacement (which identifies the
      * src pixel(s) for each dest pixel) as a function of y (the
-     * y value of the mid-points for each line).  Then generate
-     * ptaa5 by sampling the fitted vertical displacement on a
-     * regular grid in the vertical direction.  Each pta in ptaa5
-     * gives the vertical displacement for regularly sampled y values
-     * at a fixed x. */
-    vvectorPointD *ptaa5 = new vvectorPointD();  /* uniformly sampled across full height of image */
-    for (j = 0; j < nx; j++) {  /* for each column */
-        vectorPointD *pta = new vectorPointD((*ptaa4)[j]);
-        vectorPointD *ptad = new vectorPointD();
-
-        math::getQuadraticLSF(pta, &c2, &c1, &c0, NULL);
-        for (i = 0; i < ny; i++) {  /* uniformly sampled in y */
-            double y = i * sampling;
-            double val;
-            math::applyQuadraticFit(c2, c1, c0, y, &val);
-            DPoint p = (DPoint){.x = y, .y = val};
-            ptad->push_back(p);
-        }
-        ptaa5->push_back(*ptad);
-        free(ptad);
-        free(pta);
-    }
-
-    vvectorD *vdisparity = new vvectorD(ny, vectorD(nx, 0));
-    for (i = 0; i < nx; i++) {
-        for (j = 0; j < ny; j++) {
-            (*vdisparity)[j][i] = (*ptaa5)[i][j].y;
+     * y value of the mid-points for each line), all columns at
+     * once, in slices spread over threads.  Then sample the fitted
+     * vertical displacement on a regular grid in the vertical
+     * direction. */
+    double *cc2 = arena->alloc<double>(nx);
+    double *cc1 = arena->alloc<double>(nx);
+    double *cc0 = arena->alloc<double>(nx);
+    if (math::getQuadraticLSFColumns(namidys, nlines, disparities, nx, nx, cc2, cc1, cc0, NULL)) {
+        *vdisparity = fieldD();
+        return NO;
+    }
+
+    /* uniformly sampled in y, with fit j down column j; written a
+     * whole grid row at a time */
+    math::evaluateQuadraticColumns(cc2, cc1, cc0, nx, 0.0, sampling, ny, vdisparity->row(0), vdisparity->stride());
+    if (columnFits && !columnFits->resize(3, nx)) {
+        for (j = 0; j < nx; j++) {
+            columnFits->at(j, 0) = cc2[j];
+            columnFits->at(j, 1) = cc1[j];
+            columnFits->at(j, 2) = cc0[j];
         }
     }
-
-    free(famidys);
-    free(ptaa0);
-    free(ptaa1);
-    free(ptaa2);
-    free(ptaa3);
-    free(ptaa4);
-    free(ptaa5);
-
-    return [self scaleDisparity:vdisparity inputImageSize:inSize samplingInterval:sampling];
+    return YES;
 }
 
 - (void)debugHorizontals:(Mat)display
@@ -523,28 +679,28 @@ rightQuadraticCurvePoints:(vectorPointD *)rightQuadraticCurvePoints
             DPoint p = leftQuadraticCurvePoints->at(i);
             circle(display, Point2d(p.x, p.y), 20, red, -1, cv::LINE_AA);
         }
-        free(leftQuadraticCurvePoints);
+        delete leftQuadraticCurvePoints;
     }
     if (rightQuadraticCurvePoints) {
         for (int i = 0; i < rightQuadraticCurvePoints->size(); i++) {
             DPoint p = rightQuadraticCurvePoints->at(i);
             circle(display, Point2d(p.x, p.y), 20, red, -1, cv::LINE_AA);
         }
-        free(rightQuadraticCurvePoints);
+        delete rightQuadraticCurvePoints;
     }
     if (leftEndPoints) {
         for (int i = 0; i < leftEndPoints->size(); i++) {
             DPoint p = leftEndPoints->at(i);
             circle(display, Point2d(p.y, p.x), 12, yellow, -1, cv::LINE_AA);
         }
-        free(leftEndPoints);
+        delete leftEndPoints;
     }
     if (rightEndPoints) {
         for (int i = 0; i < rightEndPoints->size(); i++) {
             DPoint p = rightEndPoints->at(i);
             circle(display, Point2d(p.y, p.x), 10, yellow, -1, cv::LINE_AA);
         }
-        free(rightEndPoints);
+        delete rightEndPoints;
     }
     if (leftBound != 0) {
         line(display, Point2d(leftBound, 0), Point2d(leftBound, height), black, 5, cv::LINE_AA);
@@ -566,93 +722,14 @@ rightQuadraticCurvePoints:(vectorPointD *)rightQuadraticCurvePoints
                 circle(display, Point2d(p.x, p.y), 2, red, -1, cv::LINE_AA);
             }
         }
-        free(quadraticCurvePoints);
+        delete quadraticCurvePoints;
     }
     if (curveCenterPoints) {
         for (int i = 0; i < curveCenterPoints->size(); i++) {
             DPoint mid = curveCenterPoints->at(i);
             circle(display, Point2d(mid.x, mid.y), 3, blue, -1, cv::LINE_AA);
         }
-        free(curveCenterPoints);
+        delete curveCenterPoints;
     }
 }
 @end
-
-/**
- * Unused!!
- */
-@interface DisparityModel(Extras)
-@end
-@implementation DisparityModel(Extras)
-- (UIImage *)_apply {
-    Mat inImage = [self.inputImage mat];
-    Mat outImage = inImage.clone();
-
-    DSize inSize = (DSize){
-        .width = (double)inImage.cols,
-        .height = (double)inImage.rows
-    };
-    vvectorPointD *txtLinePts = [self convertKeypoints:self.keyPoints];
-    int w, h, d, i, j;
-    int sampling = 80;
-    int grayin = -1;
-    d = inImage.channels();
-    w = inSize.width;
-    h = inSize.height;
-
-    /**
-     * Debugging output
-     */
-    BOOL debugH = false;
-    vectorPointD *hLeftQuadraticCurvePoints = NULL;
-    vectorPointD *hRightQuadraticCurvePoints = NULL;
-    vectorPointD *hLeftEndPoints = NULL;
-    vectorPointD *hRightEndPoints = NULL;
-    double hLeftBound = 0;
-    double hRightBound = 0;
-    /** <-------------> */
-
-    /**
-     * apply the horizontal disparity map
-     *     */
-    vvectorD *hDisparity = [self getHorizontalDisparity:txtLinePts
-                                         inputImageSize:inSize
-                                       samplinginterval:sampling
-                                   quadraticCurvePoints:&hLeftQuadraticCurvePoints
-                                   quadraticCurvePoints:&hRightQuadraticCurvePoints
-                                      leftLineEndPoints:&hLeftEndPoints
-                                     rightLineEndPoints:&hRightEndPoints
-                                             leftBounds:&hLeftBound
-                                            rightBounds:&hRightBound];
-    int jsrc;
-    for (i = 0; i < h; i++) {
-
-        for (j = 0; j < w; j++) {
-            jsrc = (int)(j - hDisparity->at(i).at(j) + 0.5);
-
-            if (grayin < 0)
-                jsrc = min(max(jsrc, 0), w - 1);
-            if (jsrc >= 0 && jsrc < w){
-                //unsigned char *rowPtr = inImage.ptr(i);
-                //outImage.at<unsigned char>(i, j) = rowPtr[jsrc];
-            }
-        }
-    }
-
-
-    free(txtLinePts);
-
-    if (debugH)
-        [self debugHorizontals:outImage
-      leftQuadraticCurvePoints:hLeftQuadraticCurvePoints
-     rightQuadraticCurvePoints:hRightQuadraticCurvePoints
-                 leftEndPoints:hLeftEndPoints
-                rightEndPoints:hRightEndPoints
-                     leftBound:hLeftBound
-                    rightBound:hRightBound];
-
-    return [[UIImage alloc] initWithCVMat:outImage];
-}
-@end
-
-
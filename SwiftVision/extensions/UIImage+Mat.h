@@ -5,5 +5,7 @@
 + (instancetype _Nullable)imageWithMat:(cv::Mat)mat;
 - (instancetype _Nullable)initWithCVMat:(cv::Mat)cvMat;
 - (cv::Mat)mat;
+/// the columns and rows of the Mat that `mat` returns, without drawing it
+- (cv::Size)matSize;
 - (cv::Mat)grayScaleMat;
 @end
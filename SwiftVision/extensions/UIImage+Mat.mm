@@ -42,10 +42,15 @@
     return finalImage;
 }
 
+- (cv::Size)matSize {
+    return cv::Size(self.size.width, self.size.height);
+}
+
 - (cv::Mat)mat {
     CGColorSpaceRef colorSpace = CGImageGetColorSpace(self.CGImage);
-    CGFloat cols = self.size.width;
-    CGFloat rows = self.size.height;
+    cv::Size size = [self matSize];
+    CGFloat cols = size.width;
+    CGFloat rows = size.height;
 
     cv::Mat cvMat(rows, cols, CV_8UC4); // 8 bits per component, 4 channels (color channels + alpha)
 
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "Arena.hpp"
+
+/* Blocks start on a cache line and headers are padded to one, so block
+ * data is 64 byte aligned and any alignment up to that costs the same
+ * padding in every block */
+static const size_t kBlockAlignment = 64;
+static const size_t kBlockHeader = (sizeof(void *) + 2 * sizeof(size_t) + kBlockAlignment - 1) & ~(kBlockAlignment - 1);
+static const size_t kMinBlockSize = 4096;
+
+Arena::Arena(size_t capacity) : head(NULL), used(0), highwater(0), nallocs(0), nbytes(0) {
+    if (capacity > 0)
+        head = newBlock(capacity, 0);
+}
+
+Arena::~Arena() {
+    freeBlocks();
+}
+
+Arena::Block *Arena::newBlock(size_t size, size_t base) {
+    void *mem;
+    Block *block;
+
+    if (posix_memalign(&mem, kBlockAlignment, kBlockHeader + size))
+        return NULL;
+    block = (Block *)mem;
+    block->prev = head;
+    block->size = size;
+    block->base = base;
+    nallocs++;
+    nbytes += kBlockHeader + size;
+    return block;
+}
+
+void Arena::freeBlocks() {
+    while (head) {
+        Block *prev = head->prev;
+        free(head);
+        head = prev;
+    }
+    used = 0;
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment) {
+    size_t offset, size;
+    uintptr_t data;
+    Block *block;
+
+    if (head) {
+        /* align the address, not the offset, for alignments past the
+         * block's own */
+        data = (uintptr_t)head + kBlockHeader;
+        offset = ((data + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - data;
+        if (offset + bytes <= head->size) {
+            used = offset + bytes;
+            if (head->base + used > highwater)
+                highwater = head->base + used;
+            return (char *)data + offset;
+        }
+    }
+
+    /* Chain on a block that at least doubles the arena */
+    size = bytes + alignment;
+    if (head && size < head->base + head->size)
+        size = head->base + head->size;
+    if (size < kMinBlockSize)
+        size = kMinBlockSize;
+    if ((block = newBlock(size, head ? head->base + head->size : 0)) == NULL)
+        return NULL;
+    head = block;
+    used = 0;
+    return allocate(bytes, alignment);
+}
+
+void Arena::reset() {
+    /* Fold a chain of blocks into one that holds the whole cycle */
+    if (head && head->prev) {
+        size_t size = highwater > head->base + head->size ? highwater : head->base + head->size;
+        freeBlocks();
+        head = newBlock(size, 0);
+    }
+    used = 0;
+    highwater = 0;
+}
+
+size_t Arena::mark() const {
+    return head ? head->base + used : 0;
+}
+
+void Arena::release(size_t mark) {
+    /* Blocks filled after the mark stay chained until the arena is
+     * empty again; releasing everything is a reset() */
+    if (!head)
+        return;
+    if (mark == 0) {
+        reset();
+        return;
+    }
+    if (mark >= head->base)
+        used = mark - head->base < used ? mark - head->base : used;
+    else
+        used = 0;
+}
+
+size_t Arena::capacity() const {
+    return head ? head->base + head->size : 0;
+}
+
+void Arena::resetCounters() {
+    nallocs = 0;
+    nbytes = 0;
+}
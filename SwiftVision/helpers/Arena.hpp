@@ -0,0 +1,74 @@
+#ifndef Arena_hpp
+#define Arena_hpp
+
+#include <stddef.h>
+
+/*----------------------------------------------------------------------------*
+ *                             Scratch arena                                  *
+ *                                                                            *
+ *  A bump allocator for short lived scratch buffers.  Allocations are        *
+ *  released all at once with reset(), or back to a saved mark().  When a     *
+ *  request doesn't fit, another block is chained on; the next reset(), or    *
+ *  release() of the outermost mark, folds all blocks into a single one big   *
+ *  enough for the whole previous cycle, so a workload that repeats           *
+ *  allocates from the heap only on its first run.                            *
+ *                                                                            *
+ *  Only trivially destructible types should be allocated here; nothing is    *
+ *  ever destroyed.  The counters track the heap allocations made by the      *
+ *  arena itself since the last resetCounters().                              *
+ *----------------------------------------------------------------------------*/
+
+class Arena {
+public:
+    explicit Arena(size_t capacity = 0);
+    ~Arena();
+
+    /* alignment is a power of two; it applies to the address */
+    void *allocate(size_t bytes, size_t alignment = 16);
+
+    template <typename T>
+    T *alloc(size_t count) {
+        return (T *)allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+    }
+
+    void reset();
+    size_t mark() const;
+    void release(size_t mark);
+
+    size_t capacity() const;
+    size_t allocationCount() const { return nallocs; }
+    size_t bytesAllocated() const { return nbytes; }
+    void resetCounters();
+
+private:
+    struct Block {
+        Block  *prev;       /*!< previously filled block                    */
+        size_t size;        /*!< usable bytes in this block                 */
+        size_t base;        /*!< arena offset of the first byte             */
+    };
+
+    Block  *head;           /*!< block currently being filled               */
+    size_t used;            /*!< bytes used in the head block               */
+    size_t highwater;       /*!< most bytes used since the last reset       */
+    size_t nallocs;         /*!< heap allocations since resetCounters       */
+    size_t nbytes;          /*!< heap bytes since resetCounters             */
+
+    Block *newBlock(size_t size, size_t base);
+    void freeBlocks();
+
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+};
+
+/*! Rewinds an arena to where it was on construction */
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena *arena) : arena(arena), saved(arena ? arena->mark() : 0) {}
+    ~ArenaScope() { if (arena) arena->release(saved); }
+
+private:
+    Arena  *arena;
+    size_t saved;
+};
+
+#endif /* Arena_hpp */
@@ -0,0 +1,159 @@
+#include <string.h>
+#include "BlobScan.hpp"
+
+int BlobScan::newLabel() {
+    BlobStats stats;
+    int label;
+
+    label = (int)parent.size();
+    parent.push_back(label);
+    memset(&stats, 0, sizeof(stats));
+    stats.x = stats.y = 0x7fffffff;
+    stats.width = stats.height = -1;     /* last column and row, until folded */
+    partial.push_back(stats);
+    return label;
+}
+
+int BlobScan::find(int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+/* The older label stays the root, so blobs come out in the order of
+ * their first pixel */
+void BlobScan::join(int a,
+                    int b) {
+    a = find(a);
+    b = find(b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+int BlobScan::scan(const uint8_t *data,
+                   int width,
+                   int height,
+                   int stride) {
+    int i, j, x0, x1, k, label, prevBegin, prevEnd, curBegin, p, nlabels, nblobs;
+    double sx, sxx, n;
+
+    runs.clear();
+    parent.clear();
+    partial.clear();
+    blobs.clear();
+    w = h = 0;
+    if (!data || width < 1 || height < 1 || stride < width)
+        return 1;
+    w = width;
+    h = height;
+
+    prevBegin = prevEnd = 0;
+    for (i = 0; i < height; i++) {
+        const uint8_t *line = data + (size_t)i * stride;
+        curBegin = (int)runs.size();
+        p = prevBegin;
+        for (j = 0; j < width; ) {
+            if (!line[j]) {
+                j++;
+                continue;
+            }
+            x0 = j;
+            while (j < width && line[j])
+                j++;
+            x1 = j - 1;
+
+            /* Runs of the row above that touch this one, 8-connected:
+             * they overlap [x0 - 1, x1 + 1].  Both rows are in column
+             * order, so the scan of the row above only moves forward. */
+            while (p < prevEnd && runs[p].x1 < x0 - 1)
+                p++;
+            label = -1;
+            for (k = p; k < prevEnd && runs[k].x0 <= x1 + 1; k++) {
+                if (label < 0)
+                    label = find(runs[k].label);
+                else
+                    join(label, runs[k].label);
+            }
+            if (label < 0)
+                label = newLabel();
+
+            /* the statistics of the run go to its own label; merges
+             * are folded in once the scan is done */
+            BlobStats &s = partial[label];
+            if (x0 < s.x) s.x = x0;
+            if (x1 > s.width) s.width = x1;
+            if (i < s.y) s.y = i;
+            s.height = i;
+            n = x1 - x0 + 1;
+            sx = (double)(x0 + x1) * n / 2.0;
+            sxx = ((double)x1 * (x1 + 1) * (2.0 * x1 + 1) -
+                   (double)(x0 - 1) * x0 * (2.0 * x0 - 1)) / 6.0;
+            s.area += (int)n;
+            s.m10 += sx;
+            s.m01 += n * i;
+            s.m20 += sxx;
+            s.m11 += sx * i;
+            s.m02 += n * i * i;
+
+            Run run = { i, x0, x1, label };
+            runs.push_back(run);
+        }
+        prevBegin = curBegin;
+        prevEnd = (int)runs.size();
+    }
+
+    /* Fold every label into its root, numbering the roots in order */
+    nlabels = (int)parent.size();
+    std::vector<int> index(nlabels, -1);
+    for (nblobs = 0, k = 0; k < nlabels; k++) {
+        if (find(k) == k)
+            index[k] = nblobs++;
+    }
+    blobs.resize(nblobs);
+    for (k = 0; k < nlabels; k++) {
+        if (index[k] >= 0)
+            blobs[index[k]] = partial[k];
+    }
+    for (k = 0; k < nlabels; k++) {
+        if (index[k] >= 0)
+            continue;
+        const BlobStats &s = partial[k];
+        BlobStats &b = blobs[index[find(k)]];
+        if (s.x < b.x) b.x = s.x;
+        if (s.y < b.y) b.y = s.y;
+        if (s.width > b.width) b.width = s.width;
+        if (s.height > b.height) b.height = s.height;
+        b.area += s.area;
+        b.m10 += s.m10;
+        b.m01 += s.m01;
+        b.m20 += s.m20;
+        b.m11 += s.m11;
+        b.m02 += s.m02;
+    }
+    for (k = 0; k < nblobs; k++) {
+        blobs[k].width -= blobs[k].x - 1;
+        blobs[k].height -= blobs[k].y - 1;
+    }
+    for (k = 0; k < (int)runs.size(); k++)
+        runs[k].label = index[find(runs[k].label)];
+    return 0;
+}
+
+int BlobScan::erase(const uint8_t *keep,
+                    uint8_t *data,
+                    int stride) const {
+    int k;
+
+    if (!keep || !data || stride < w)
+        return 1;
+    for (k = 0; k < (int)runs.size(); k++) {
+        const Run &run = runs[k];
+        if (!keep[run.label])
+            memset(data + (size_t)run.y * stride + run.x0, 0, run.x1 - run.x0 + 1);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef BlobScan_hpp
+#define BlobScan_hpp
+
+#include <stdint.h>
+#include <vector>
+
+/*----------------------------------------------------------------------------*
+ *                          Blob statistics scan                              *
+ *                                                                            *
+ *  Labels the 8-connected blobs of nonzero pixels in a single raster         *
+ *  scan, the same blobs whose outer outlines findContours() traces.  Each    *
+ *  row is split into runs; a run joins the blobs of the runs touching it     *
+ *  in the row above (union-find over the labels), and its pixels are added   *
+ *  to its label's statistics as the scan goes.  Merged labels are folded     *
+ *  into their root once the scan is done, so no pixel is visited twice.      *
+ *                                                                            *
+ *  Per blob: bounding box, pixel count and the raw moments up to second      *
+ *  order.  The runs are kept, so erase() can clear rejected blobs from       *
+ *  the image before any outline is traced.                                   *
+ *----------------------------------------------------------------------------*/
+
+struct BlobStats {
+    int     x, y;           /*!< top left corner of the bounds              */
+    int     width, height;  /*!< size of the bounds, as cv::boundingRect    */
+    int     area;           /*!< pixels in the blob                         */
+    double  m10, m01;       /*!< sums of x and y over the pixels            */
+    double  m20, m11, m02;  /*!< sums of x * x, x * y and y * y             */
+};
+
+class BlobScan {
+public:
+    /* Scans a width x height 8 bpp image, rows stride bytes apart;
+     * returns 1 on bad input */
+    int scan(const uint8_t *data, int width, int height, int stride);
+
+    int count() const { return (int)blobs.size(); }
+    const BlobStats &blob(int k) const { return blobs[k]; }
+
+    /* Zeroes the pixels of every blob k with keep[k] == 0, in the image
+     * that was scanned (or a copy with the same size) */
+    int erase(const uint8_t *keep, uint8_t *data, int stride) const;
+
+private:
+    struct Run {
+        int     y, x0, x1;  /*!< row and first and last column              */
+        int     label;      /*!< provisional label, then blob index         */
+    };
+
+    std::vector<Run>        runs;       /*!< all runs, in raster order          */
+    std::vector<int>        parent;     /*!< union-find over the labels         */
+    std::vector<BlobStats>  partial;    /*!< statistics of each label           */
+    std::vector<BlobStats>  blobs;      /*!< merged statistics of each blob     */
+    int                     w, h;
+
+    int newLabel();
+    int find(int label);
+    void join(int a, int b);
+};
+
+#endif /* BlobScan_hpp */
@@ -0,0 +1,282 @@
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include "ContourBatch.hpp"
+#include "parallel.hpp"
+
+/* Points per chunk below which compute() stays on one thread */
+static const int kMinChunkPoints = 1 << 14;
+
+void ContourBatch::clear() {
+    offsets.resize(1);
+    level.clear();
+    xs.clear();
+    ys.clear();
+    coloffsets.clear();
+}
+
+void ContourBatch::reserve(int ncontours,
+                           int npoints) {
+    offsets.reserve(ncontours + 1);
+    level.reserve(ncontours);
+    xs.reserve(npoints);
+    ys.reserve(npoints);
+}
+
+int ContourBatch::add(const int *xy,
+                      int n) {
+    int i, base;
+
+    if (!xy || n < 1)
+        return -1;
+    base = (int)xs.size();
+    xs.resize(base + n);
+    ys.resize(base + n);
+    for (i = 0; i < n; i++) {
+        xs[base + i] = xy[2 * i];
+        ys[base + i] = xy[2 * i + 1];
+    }
+    offsets.push_back(base + n);
+    level.push_back(0);
+    return count() - 1;
+}
+
+int ContourBatch::compute(int tier) {
+    int n, k, grain;
+
+    n = count();
+    if (tier < CONTOUR_BOUNDS || tier > CONTOUR_PROFILE)
+        return 1;
+    bx.resize(n);
+    by.resize(n);
+    bw.resize(n);
+    bh.resize(n);
+    m00.resize(n);
+    cx.resize(n);
+    cy.resize(n);
+    tx.resize(n);
+    ty.resize(n);
+    lmin.resize(n);
+    lmax.resize(n);
+    thick.resize(n);
+    if (n == 0)
+        return 0;
+
+    /* Split by contours, about kMinChunkPoints points per chunk */
+    grain = (int)((long long)n * kMinChunkPoints / (pointCount() + 1)) + 1;
+    parallel::forRange(n, grain, [this, tier](int begin, int end) {
+        computeRange(begin, end, std::min(tier, (int)CONTOUR_PROJECTIONS));
+    });
+    if (tier < CONTOUR_PROFILE)
+        return 0;
+
+    /* The column profiles are laid out once, when every contour still
+     * in the batch has its bounds; rejected ones get no columns */
+    if ((int)coloffsets.size() != n + 1) {
+        coloffsets.resize(n + 1);
+        coloffsets[0] = 0;
+        for (k = 0; k < n; k++)
+            coloffsets[k + 1] = coloffsets[k] + (rejected(k) ? 0 : bw[k]);
+        colmean.resize(coloffsets[n]);
+    }
+    parallel::forRange(n, grain, [this](int begin, int end) {
+        computeRange(begin, end, CONTOUR_PROFILE);
+    });
+    return 0;
+}
+
+void ContourBatch::computeRange(int begin,
+                                int end,
+                                int tier) {
+    std::vector<int> keys;
+
+    for (int k = begin; k < end; k++) {
+        if (level[k] < 0 || level[k] >= tier)
+            continue;
+        if (level[k] < CONTOUR_BOUNDS)
+            computeBounds(k);
+        if (tier >= CONTOUR_MOMENTS && level[k] < CONTOUR_MOMENTS)
+            computeMoments(k);
+        if (tier >= CONTOUR_PROJECTIONS && level[k] < CONTOUR_PROJECTIONS)
+            computeProjections(k);
+        if (tier >= CONTOUR_PROFILE)
+            computeProfile(k, &keys);
+        level[k] = tier;
+    }
+}
+
+/* Unit major eigenvector of the symmetric matrix [a b; b c], which is
+ * what the first column of U from SVDecomp() is for a covariance */
+static void majorAxis(double a,
+                      double b,
+                      double c,
+                      double *px,
+                      double *py) {
+    double l1, x, y, len;
+
+    l1 = 0.5 * (a + c) + sqrt(0.25 * (a - c) * (a - c) + b * b);
+    if (fabs(b) > DBL_EPSILON * (fabs(a) + fabs(c))) {
+        /* (A - l1 I) v = 0; take the row with the larger entries */
+        if (fabs(a - l1) > fabs(c - l1)) {
+            x = -b;
+            y = a - l1;
+        } else {
+            x = c - l1;
+            y = -b;
+        }
+        len = sqrt(x * x + y * y);
+        x /= len;
+        y /= len;
+    } else {
+        x = (a >= c) ? 1.0 : 0.0;
+        y = (a >= c) ? 0.0 : 1.0;
+    }
+    if (x < 0.0 || (x == 0.0 && y < 0.0)) {
+        x = -x;
+        y = -y;
+    }
+    *px = x;
+    *py = y;
+}
+
+void ContourBatch::computeBounds(int k) {
+    int i, n;
+    double xmin, xmax, ymin, ymax;
+    const double *x = &xs[0] + offsets[k];
+    const double *y = &ys[0] + offsets[k];
+
+    n = offsets[k + 1] - offsets[k];
+    xmin = xmax = x[0];
+    ymin = ymax = y[0];
+    for (i = 1; i < n; i++) {
+        xmin = (x[i] < xmin) ? x[i] : xmin;
+        xmax = (x[i] > xmax) ? x[i] : xmax;
+        ymin = (y[i] < ymin) ? y[i] : ymin;
+        ymax = (y[i] > ymax) ? y[i] : ymax;
+    }
+    bx[k] = (int)xmin;
+    by[k] = (int)ymin;
+    bw[k] = (int)(xmax - xmin) + 1;
+    bh[k] = (int)(ymax - ymin) + 1;
+}
+
+void ContourBatch::computeMoments(int k) {
+    int i, n;
+    double a00, a10, a01, a20, a11, a02, dxy, xi, yi, xi_1, yi_1, xii_1, yii_1;
+    double mx, my, mu20, mu11, mu02;
+    const double *x = &xs[0] + offsets[k];
+    const double *y = &ys[0] + offsets[k];
+
+    /* The moments of the closed polygon by Green's theorem, summed
+     * over the edges as cv::moments() does */
+    n = offsets[k + 1] - offsets[k];
+    a00 = a10 = a01 = a20 = a11 = a02 = 0.0;
+    xi_1 = x[n - 1];
+    yi_1 = y[n - 1];
+    for (i = 0; i < n; i++) {
+        xi = x[i];
+        yi = y[i];
+        dxy = xi_1 * yi - xi * yi_1;
+        xii_1 = xi_1 + xi;
+        yii_1 = yi_1 + yi;
+        a00 += dxy;
+        a10 += dxy * xii_1;
+        a01 += dxy * yii_1;
+        a20 += dxy * (xi_1 * xii_1 + xi * xi);
+        a11 += dxy * (xi_1 * (yii_1 + yi_1) + xi * (yii_1 + yi));
+        a02 += dxy * (yi_1 * yii_1 + yi * yi);
+        xi_1 = xi;
+        yi_1 = yi;
+    }
+
+    if (fabs(a00) > FLT_EPSILON) {
+        if (a00 < 0.0) {
+            a00 = -a00; a10 = -a10; a01 = -a01;
+            a20 = -a20; a11 = -a11; a02 = -a02;
+        }
+        m00[k] = a00 / 2.0;
+        mx = (a10 / 6.0) / m00[k];
+        my = (a01 / 6.0) / m00[k];
+        mu20 = a20 / 12.0 - mx * a10 / 6.0;
+        mu11 = a11 / 24.0 - mx * a01 / 6.0;
+        mu02 = a02 / 12.0 - my * a01 / 6.0;
+    } else {
+        /* No area (a line or a single point): cv::moments() has
+         * nothing to offer, so use the spread of the points */
+        m00[k] = 0.0;
+        for (mx = my = 0.0, i = 0; i < n; i++) {
+            mx += x[i];
+            my += y[i];
+        }
+        mx /= n;
+        my /= n;
+        for (mu20 = mu11 = mu02 = 0.0, i = 0; i < n; i++) {
+            mu20 += (x[i] - mx) * (x[i] - mx);
+            mu11 += (x[i] - mx) * (y[i] - my);
+            mu02 += (y[i] - my) * (y[i] - my);
+        }
+    }
+    cx[k] = mx;
+    cy[k] = my;
+    majorAxis(mu20, mu11, mu02, &tx[k], &ty[k]);
+}
+
+void ContourBatch::computeProjections(int k) {
+    int i, n;
+    double mx, my, ux, uy, d, dmin, dmax;
+    const double *x = &xs[0] + offsets[k];
+    const double *y = &ys[0] + offsets[k];
+
+    /* extent along the tangent, measured from the center */
+    n = offsets[k + 1] - offsets[k];
+    mx = cx[k];
+    my = cy[k];
+    ux = tx[k];
+    uy = ty[k];
+    dmin = dmax = ux * (x[0] - mx) + uy * (y[0] - my);
+    for (i = 1; i < n; i++) {
+        d = ux * (x[i] - mx) + uy * (y[i] - my);
+        dmin = (d < dmin) ? d : dmin;
+        dmax = (d > dmax) ? d : dmax;
+    }
+    lmin[k] = dmin;
+    lmax[k] = dmax;
+}
+
+void ContourBatch::computeProfile(int k,
+                                  std::vector<int> *keys) {
+    int i, n, col, count, sum, x0, y0, h;
+    int *key;
+    float *means;
+    const double *x = &xs[0] + offsets[k];
+    const double *y = &ys[0] + offsets[k];
+
+    /* Column profile of the outline.  An outline pixel may be visited
+     * twice where the contour doubles back, so the pixels are sorted
+     * by column then row and each is counted once.  Every column of
+     * the bounds holds at least one. */
+    n = offsets[k + 1] - offsets[k];
+    x0 = bx[k];
+    y0 = by[k];
+    h = bh[k];
+    keys->resize(n);
+    key = &(*keys)[0];
+    for (i = 0; i < n; i++)
+        key[i] = ((int)x[i] - x0) * h + ((int)y[i] - y0);
+    std::sort(key, key + n);
+    means = &colmean[0] + coloffsets[k];
+    std::fill(means, means + bw[k], 0.0f);
+    thick[k] = 0;
+    for (i = 0; i < n; ) {
+        col = key[i] / h;
+        for (count = 0, sum = 0; i < n && key[i] / h == col; i++) {
+            if (i > 0 && key[i] == key[i - 1])
+                continue;
+            count++;
+            sum += key[i] % h;
+        }
+        means[col] = (float)sum / count;
+        if (count > thick[k])
+            thick[k] = count;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef ContourBatch_hpp
+#define ContourBatch_hpp
+
+#include <vector>
+
+/*----------------------------------------------------------------------------*
+ *                             Contour batch                                  *
+ *                                                                            *
+ *  The points of every contour on a page in one structure of arrays: all     *
+ *  x coordinates, then all y coordinates, with contour k owning points       *
+ *  [offset(k), offset(k + 1)).  The features of each contour go into        *
+ *  parallel arrays, in tiers of increasing cost:                             *
+ *                                                                            *
+ *    CONTOUR_BOUNDS       the bounding box;                                  *
+ *    CONTOUR_MOMENTS      the polygon moments up to second order (the ones   *
+ *                         cv::moments() returns for a contour), giving area  *
+ *                         and center, and the tangent: the major             *
+ *                         eigenvector of the 2x2 central moment matrix, in   *
+ *                         closed form;                                       *
+ *    CONTOUR_PROJECTIONS  the min and max projections of the points onto     *
+ *                         the tangent (clx, measured from the center);       *
+ *    CONTOUR_PROFILE      for each column of the bounds, the number of       *
+ *                         distinct outline pixels in it and their mean row:  *
+ *                         what summing and row-weighting a mask of the       *
+ *                         outline used to give, without drawing the mask.    *
+ *                         The thickness is the largest of the counts.        *
+ *                                                                            *
+ *  compute(tier) brings every contour that hasn't been rejected up to the    *
+ *  tier, computing only what it lacks, so a caller can test the cheap        *
+ *  features, reject(), and only then ask for the costly ones.  Add all       *
+ *  contours before the first compute().                                     *
+ *                                                                            *
+ *  The tangent is oriented to point right (x >= 0, or down when vertical),   *
+ *  so contours along one text line agree on its direction.  Points are       *
+ *  added as x, y int pairs, the layout of a std::vector<cv::Point>, and      *
+ *  nothing here depends on OpenCV or Foundation.                             *
+ *----------------------------------------------------------------------------*/
+
+enum {
+    CONTOUR_BOUNDS = 1,
+    CONTOUR_MOMENTS = 2,
+    CONTOUR_PROJECTIONS = 3,
+    CONTOUR_PROFILE = 4
+};
+
+class ContourBatch {
+public:
+    ContourBatch() { offsets.push_back(0); }
+
+    /* Drops all contours, keeping the capacity */
+    void clear();
+    void reserve(int ncontours, int npoints);
+
+    /* Appends a contour of n points, xy holding x0, y0, x1, y1, ...;
+     * returns its index, or -1 if n < 1 */
+    int add(const int *xy, int n);
+
+    /* Fills in the features up to tier of every contour that hasn't
+     * been rejected; 0 on success */
+    int compute(int tier = CONTOUR_PROFILE);
+
+    /* Leaves contour k out of later compute() calls */
+    void reject(int k) { level[k] = -1; }
+    bool rejected(int k) const { return level[k] < 0; }
+    /* the highest tier computed for contour k */
+    int tier(int k) const { return level[k] < 0 ? 0 : level[k]; }
+
+    int count() const { return (int)offsets.size() - 1; }
+    int pointCount() const { return (int)xs.size(); }
+    int offset(int k) const { return offsets[k]; }
+    int size(int k) const { return offsets[k + 1] - offsets[k]; }
+    const double *x(int k) const { return &xs[0] + offsets[k]; }
+    const double *y(int k) const { return &ys[0] + offsets[k]; }
+
+    /* features, valid once computed to their tier */
+    int boundsX(int k) const { return bx[k]; }
+    int boundsY(int k) const { return by[k]; }
+    int boundsWidth(int k) const { return bw[k]; }
+    int boundsHeight(int k) const { return bh[k]; }
+    double area(int k) const { return m00[k]; }
+    double centerX(int k) const { return cx[k]; }
+    double centerY(int k) const { return cy[k]; }
+    double tangentX(int k) const { return tx[k]; }
+    double tangentY(int k) const { return ty[k]; }
+    double clxMin(int k) const { return lmin[k]; }
+    double clxMax(int k) const { return lmax[k]; }
+    int thickness(int k) const { return thick[k]; }
+    /* mean row of the outline in each of the boundsWidth(k) columns,
+     * relative to boundsY(k) */
+    const float *columnMeans(int k) const { return &colmean[0] + coloffsets[k]; }
+
+private:
+    std::vector<int>    offsets;    /*!< first point of each contour, and the end   */
+    std::vector<int>    level;      /*!< tier computed, -1 when rejected            */
+    std::vector<double> xs, ys;     /*!< point coordinates, all contours            */
+    std::vector<int>    bx, by;     /*!< top left corner of the bounds              */
+    std::vector<int>    bw, bh;     /*!< size of the bounds, as cv::boundingRect    */
+    std::vector<double> m00;        /*!< enclosed area                              */
+    std::vector<double> cx, cy;     /*!< center of mass                             */
+    std::vector<double> tx, ty;     /*!< unit tangent                               */
+    std::vector<double> lmin, lmax; /*!< extent of the points along the tangent     */
+    std::vector<int>    thick;      /*!< most outline pixels in a column            */
+    std::vector<int>    coloffsets; /*!< first column mean of each contour          */
+    std::vector<float>  colmean;    /*!< mean outline row per column, all contours  */
+
+    void computeRange(int begin, int end, int tier);
+    void computeBounds(int k);
+    void computeMoments(int k);
+    void computeProjections(int k);
+    void computeProfile(int k, std::vector<int> *keys);
+};
+
+#endif /* ContourBatch_hpp */
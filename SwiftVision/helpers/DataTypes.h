@@ -2,6 +2,7 @@
 #define datatypes_h
 
 #include <stdio.h>
+#include <stdint.h>
 #include <vector>
 #include "PtraArray.hpp"
 
@@ -28,5 +29,15 @@ typedef std::vector<double> vectorD;
 typedef std::vector<std::vector<double>> vvectorD;
 typedef std::vector<DPoint> vectorPointD;
 typedef std::vector<std::vector<DPoint>> vvectorPointD;
+typedef std::vector<uint32_t> vectorIndex;
+
+/* Non-owning view of caller-owned storage */
+template <typename T>
+struct Span {
+    T   *data;
+    int size;
+};
+
+typedef Span<const double> constSpanD;
 
 #endif /* datatypes_h */
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#include "DewarpModel.hpp"
+
+static_assert(sizeof(DewarpModelHeader) == DEWARP_MODEL_HEADER_SIZE, "model header layout");
+/* save() writes the header and fields as they are in memory, and load()
+ * maps them back without conversion, so the file is little endian only
+ * because the host is */
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "model files are little endian");
+static_assert(sizeof(double) == 8, "model fields are IEEE-754 doubles");
+
+DewarpModel::DewarpModel()
+    : width(0), height(0), sampling(0), mapping(NULL), maplength(0) {
+    for (int k = 0; k < 3; k++)
+        leftMargin[k] = rightMargin[k] = 0.0;
+}
+
+DewarpModel::~DewarpModel() {
+    unmap();
+}
+
+void DewarpModel::unmap() {
+    /* drop the views before the memory they look into */
+    vertical = fieldD();
+    horizontal = fieldD();
+    columnFits = fieldD();
+    if (mapping)
+        munmap(mapping, maplength);
+    mapping = NULL;
+    maplength = 0;
+}
+
+/* A model must be for a real image, with a grid that reaches its last
+ * row and column */
+static bool validGeometry(int width,
+                          int height,
+                          int sampling,
+                          int nx,
+                          int ny) {
+    if (width < 1 || height < 1 || sampling < 1 || nx < 1 || ny < 1)
+        return false;
+    return (long long)(nx - 1) * sampling >= width - 1 &&
+           (long long)(ny - 1) * sampling >= height - 1;
+}
+
+static int writeRows(FILE *fp,
+                     const fieldD *field) {
+    for (int i = 0; i < field->height(); i++) {
+        if (fwrite(field->row(i), sizeof(double), field->width(), fp) != (size_t)field->width())
+            return 1;
+    }
+    return 0;
+}
+
+int DewarpModel::save(const char *path) const {
+    DewarpModelHeader header;
+    FILE *fp;
+    int ret, k;
+
+    if (!path || !validGeometry(width, height, sampling, vertical.width(), vertical.height()))
+        return 1;
+    if (!horizontal.empty() &&
+        (horizontal.width() != vertical.width() || horizontal.height() != vertical.height()))
+        return 1;
+    if (columnFits.width() != 3 || columnFits.height() != vertical.width())
+        return 1;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = DEWARP_MODEL_MAGIC;
+    header.version = DEWARP_MODEL_VERSION;
+    header.headerSize = DEWARP_MODEL_HEADER_SIZE;
+    header.flags = horizontal.empty() ? 0 : DEWARP_MODEL_HORIZONTAL;
+    header.width = width;
+    header.height = height;
+    header.sampling = sampling;
+    header.nx = vertical.width();
+    header.ny = vertical.height();
+    for (k = 0; k < 3; k++) {
+        header.leftMargin[k] = leftMargin[k];
+        header.rightMargin[k] = rightMargin[k];
+    }
+
+    if ((fp = fopen(path, "wb")) == NULL)
+        return 1;
+    ret = fwrite(&header, sizeof(header), 1, fp) != 1;
+    if (!ret)
+        ret = writeRows(fp, &vertical);
+    if (!ret && !horizontal.empty())
+        ret = writeRows(fp, &horizontal);
+    if (!ret)
+        ret = writeRows(fp, &columnFits);
+    if (fclose(fp))
+        ret = 1;
+    return ret;
+}
+
+int DewarpModel::load(const char *path) {
+    int fd, nx, ny;
+    size_t expected;
+    struct stat st;
+    void *mem;
+    double *data;
+    const DewarpModelHeader *header;
+
+    unmap();
+    if (!path)
+        return 1;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 1;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(DewarpModelHeader)) {
+        close(fd);
+        return 1;
+    }
+    /* private and writable: the fields can be rescaled in place without
+     * touching the file */
+    mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        return 1;
+    mapping = mem;
+    maplength = (size_t)st.st_size;
+
+    /* The magic is the byte order mark: a big endian file reads as
+     * DEWARP_MODEL_MAGIC_SWAPPED, and its numbers would all be garbage */
+    header = (const DewarpModelHeader *)mem;
+    nx = header->nx;
+    ny = header->ny;
+    if (header->magic == DEWARP_MODEL_MAGIC_SWAPPED) {
+        unmap();
+        return 1;
+    }
+    if (header->magic != DEWARP_MODEL_MAGIC || header->version != DEWARP_MODEL_VERSION ||
+        header->headerSize != DEWARP_MODEL_HEADER_SIZE ||
+        !validGeometry(header->width, header->height, header->sampling, nx, ny)) {
+        unmap();
+        return 1;
+    }
+    expected = DEWARP_MODEL_HEADER_SIZE +
+               sizeof(double) * ((size_t)nx * ny * ((header->flags & DEWARP_MODEL_HORIZONTAL) ? 2 : 1) + (size_t)nx * 3);
+    if (maplength != expected) {
+        unmap();
+        return 1;
+    }
+
+    width = header->width;
+    height = header->height;
+    sampling = header->sampling;
+    for (int k = 0; k < 3; k++) {
+        leftMargin[k] = header->leftMargin[k];
+        rightMargin[k] = header->rightMargin[k];
+    }
+    data = (double *)((char *)mem + DEWARP_MODEL_HEADER_SIZE);
+    vertical = fieldD(data, nx, ny, nx);
+    data += (size_t)nx * ny;
+    if (header->flags & DEWARP_MODEL_HORIZONTAL) {
+        horizontal = fieldD(data, nx, ny, nx);
+        data += (size_t)nx * ny;
+    }
+    columnFits = fieldD(data, 3, nx, 3);
+    return 0;
+}
+
+/* Bilinear sample of a grid with the given spacing at pixel (x, y) */
+static double sampleGrid(const fieldD *grid,
+                         int sampling,
+                         double x,
+                         double y) {
+    int gi, gj, gi1, gj1;
+    double u, v, fx, fy;
+
+    u = std::min(std::max(x / sampling, 0.0), (double)(grid->width() - 1));
+    v = std::min(std::max(y / sampling, 0.0), (double)(grid->height() - 1));
+    gj = (int)u;
+    gi = (int)v;
+    gj1 = std::min(gj + 1, grid->width() - 1);
+    gi1 = std::min(gi + 1, grid->height() - 1);
+    fx = u - gj;
+    fy = v - gi;
+    return (grid->at(gi, gj) * (1.0 - fx) + grid->at(gi, gj1) * fx) * (1.0 - fy) +
+           (grid->at(gi1, gj) * (1.0 - fx) + grid->at(gi1, gj1) * fx) * fy;
+}
+
+int DewarpModel::flatness(const vvectorPointD *lines,
+                          int maxlines,
+                          double *pmean,
+                          double *pmax) const {
+    int i, k, n, nlines, nused;
+    double y, mean, var, rms, sum, largest;
+
+    if (pmean) *pmean = 0.0;
+    if (pmax) *pmax = 0.0;
+    if (!lines || vertical.empty() || sampling <= 0)
+        return 1;
+    nlines = (int)lines->size();
+    if (maxlines < 1 || maxlines > nlines)
+        maxlines = nlines;
+    if (maxlines < 1)
+        return 1;
+
+    /* A point at source row y lands on output row y + v(x, y); the
+     * disparity is smooth, so evaluating it at y rather than at the
+     * output row is good to a small fraction of a pixel. */
+    std::vector<double> warped;
+    sum = largest = 0.0;
+    for (nused = 0, k = 0; k < maxlines; k++) {
+        const vectorPointD &line = (*lines)[(size_t)k * nlines / maxlines];
+        n = (int)line.size();
+        if (n < 2)
+            continue;
+        warped.resize(n);
+        for (mean = 0.0, i = 0; i < n; i++) {
+            y = line[i].y + sampleGrid(&vertical, sampling, line[i].x, line[i].y);
+            warped[i] = y;
+            mean += y;
+        }
+        mean /= n;
+        for (var = 0.0, i = 0; i < n; i++)
+            var += (warped[i] - mean) * (warped[i] - mean);
+        rms = sqrt(var / n);
+        sum += rms;
+        largest = std::max(largest, rms);
+        nused++;
+    }
+    if (nused == 0)
+        return 1;
+    if (pmean) *pmean = sum / nused;
+    if (pmax) *pmax = largest;
+    return 0;
+}
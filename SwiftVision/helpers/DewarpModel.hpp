@@ -0,0 +1,97 @@
+#ifndef DewarpModel_hpp
+#define DewarpModel_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DataTypes.h"
+#include "Field2D.hpp"
+
+/*----------------------------------------------------------------------------*
+ *                          Persistent dewarp model                           *
+ *                                                                            *
+ *  Everything needed to warp another image of the same page geometry         *
+ *  without fitting anything again: the size of the image the model was       *
+ *  fitted at, the grid spacing, the sampled vertical and (optional)          *
+ *  horizontal disparities and the fits they were sampled from.               *
+ *                                                                            *
+ *  save() writes it as one flat little endian file (the magic, "SVDM",       *
+ *  doubles as the byte order mark, so load() rejects a byte swapped one):    *
+ *      header      128 bytes, see DewarpModelHeader                          *
+ *      vertical    ny rows of nx doubles                                     *
+ *      horizontal  ny rows of nx doubles, if DEWARP_MODEL_HORIZONTAL         *
+ *      columnFits  nx rows of 3 doubles                                      *
+ *  load() rejects a file of the wrong size, and a header with no image       *
+ *  (width or height below 1) or a grid that stops short of the last row      *
+ *  or column: (nx - 1) * sampling >= width - 1, and the same for ny.         *
+ *  load() maps the file privately (copy on write), and the fields are        *
+ *  views into the mapping, so loading costs a page fault per 4 kB touched.   *
+ *                                                                            *
+ *  flatness() is the cheap validation for a reused model: lines detected     *
+ *  on the new image should come out flat after the warp, so it measures      *
+ *  how far their points still are from flat once the vertical disparity      *
+ *  is applied.                                                               *
+ *----------------------------------------------------------------------------*/
+
+enum {
+    DEWARP_MODEL_MAGIC = 0x4d445653,    /* "SVDM" */
+    DEWARP_MODEL_MAGIC_SWAPPED = 0x5356444d,
+    DEWARP_MODEL_VERSION = 1,
+    DEWARP_MODEL_HEADER_SIZE = 128,
+    DEWARP_MODEL_HORIZONTAL = 1 << 0
+};
+
+struct DewarpModelHeader {
+    uint32_t magic;             /*!< DEWARP_MODEL_MAGIC                         */
+    uint32_t version;           /*!< DEWARP_MODEL_VERSION                       */
+    uint32_t headerSize;        /*!< DEWARP_MODEL_HEADER_SIZE                   */
+    uint32_t flags;             /*!< DEWARP_MODEL_HORIZONTAL if present         */
+    int32_t  width;             /*!< image width the model was fitted at        */
+    int32_t  height;            /*!< image height the model was fitted at       */
+    int32_t  sampling;          /*!< grid spacing in pixels                     */
+    int32_t  nx;                /*!< grid columns                               */
+    int32_t  ny;                /*!< grid rows                                  */
+    int32_t  reserved;
+    double   leftMargin[3];     /*!< left margin x(y), highest power first      */
+    double   rightMargin[3];    /*!< right margin x(y), highest power first     */
+    uint8_t  padding[128 - 88];
+};
+
+class DewarpModel {
+public:
+    DewarpModel();
+    ~DewarpModel();
+
+    int     width;              /*!< image width the model was fitted at        */
+    int     height;             /*!< image height the model was fitted at       */
+    int     sampling;           /*!< grid spacing in pixels                     */
+    fieldD  vertical;           /*!< sampled vertical disparity, ny x nx        */
+    fieldD  horizontal;         /*!< sampled horizontal disparity; may be empty */
+    fieldD  columnFits;         /*!< c2, c1, c0 of the vertical disparity down
+                                     each grid column, as a function of y       */
+    double  leftMargin[3];      /*!< margin fits; zero without horizontal       */
+    double  rightMargin[3];
+
+    int save(const char *path) const;
+    int load(const char *path);
+    bool mapped() const { return mapping != NULL; }
+
+    /* Mean and largest rms distance from flat, in pixels, of at most
+     * maxlines of the lines (spread evenly over them) after the vertical
+     * disparity is applied.  The lines are in the coordinates of the
+     * image the model was fitted at. */
+    int flatness(const vvectorPointD *lines,
+                 int maxlines,
+                 double *pmean,
+                 double *pmax) const;
+
+private:
+    void    *mapping;           /*!< mapped file, if loaded                     */
+    size_t  maplength;          /*!< bytes mapped                               */
+
+    void unmap();
+
+    DewarpModel(const DewarpModel &);
+    DewarpModel &operator=(const DewarpModel &);
+};
+
+#endif /* DewarpModel_hpp */
@@ -0,0 +1,151 @@
+#ifndef Field2D_hpp
+#define Field2D_hpp
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*----------------------------------------------------------------------------*
+ *                          Contiguous 2D field                               *
+ *                                                                            *
+ *  A width x height grid of values in one aligned allocation.  Rows are      *
+ *  stride elements apart; the stride is padded to a multiple of 64 bytes     *
+ *  so every row starts on a cache line and SIMD loads of a row stay          *
+ *  aligned.  view() returns a non-owning field over a sub-region (or over    *
+ *  caller-owned memory), sharing the parent's stride.                        *
+ *                                                                            *
+ *  Fields are move-only; a view must not outlive the field it looks into.    *
+ *----------------------------------------------------------------------------*/
+
+template <typename T>
+class Field2D {
+public:
+    enum { ALIGNMENT = 64 };
+
+    Field2D() : data(NULL), w(0), h(0), wpl(0), capacity(0), owned(false) {}
+
+    Field2D(int width, int height) : data(NULL), w(0), h(0), wpl(0), capacity(0), owned(false) {
+        resize(width, height);
+    }
+
+    /* non-owning field over caller memory */
+    Field2D(T *data, int width, int height, int stride)
+        : data(data), w(width), h(height), wpl(stride), capacity(0), owned(false) {}
+
+    Field2D(Field2D &&other)
+        : data(other.data), w(other.w), h(other.h), wpl(other.wpl),
+          capacity(other.capacity), owned(other.owned) {
+        other.data = NULL;
+        other.capacity = 0;
+        other.owned = false;
+        other.w = other.h = other.wpl = 0;
+    }
+
+    Field2D &operator=(Field2D &&other) {
+        if (this != &other) {
+            release();
+            data = other.data;
+            w = other.w;
+            h = other.h;
+            wpl = other.wpl;
+            capacity = other.capacity;
+            owned = other.owned;
+            other.data = NULL;
+            other.capacity = 0;
+            other.owned = false;
+            other.w = other.h = other.wpl = 0;
+        }
+        return *this;
+    }
+
+    ~Field2D() { release(); }
+
+    /* Sets the size, reallocating only when the current storage is too
+     * small or not owned.  The contents are zeroed.  Returns 1 on failure. */
+    int resize(int width, int height) {
+        size_t stride, bytes;
+        void *mem;
+
+        if (width < 0 || height < 0)
+            return 1;
+        stride = ((size_t)width * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT / sizeof(T);
+        bytes = stride * height * sizeof(T);
+        if (!owned || stride * height > capacity) {
+            release();
+            mem = NULL;
+            if (bytes > 0 && posix_memalign(&mem, ALIGNMENT, bytes))
+                return 1;
+            data = (T *)mem;
+            capacity = stride * height;
+            owned = true;
+        }
+        w = width;
+        h = height;
+        wpl = (int)stride;
+        if (bytes > 0)
+            memset(data, 0, bytes);
+        return 0;
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int stride() const { return wpl; }
+    bool empty() const { return w == 0 || h == 0; }
+
+    T *row(int i) { return data + (size_t)i * wpl; }
+    const T *row(int i) const { return data + (size_t)i * wpl; }
+
+    T &at(int i, int j) { return data[(size_t)i * wpl + j]; }
+    const T &at(int i, int j) const { return data[(size_t)i * wpl + j]; }
+
+    /* w x h sub-region with its top left corner at column x, row y */
+    Field2D view(int x, int y, int width, int height) {
+        if (x < 0 || y < 0 || width < 0 || height < 0 || x + width > w || y + height > h)
+            return Field2D();
+        return Field2D(row(y) + x, width, height, wpl);
+    }
+
+    /* Resizes to the size of src and copies its values; the result
+     * always owns its storage.  Returns 1 on failure. */
+    int copyFrom(const Field2D &src) {
+        if (&src == this)
+            return 0;
+        if (resize(src.w, src.h))
+            return 1;
+        for (int i = 0; i < h; i++)
+            memcpy(row(i), src.row(i), (size_t)w * sizeof(T));
+        return 0;
+    }
+
+    void fill(T val) {
+        for (int i = 0; i < h; i++) {
+            T *line = row(i);
+            for (int j = 0; j < w; j++)
+                line[j] = val;
+        }
+    }
+
+private:
+    T       *data;      /*!< first element of row 0                     */
+    int     w;          /*!< elements per row                           */
+    int     h;          /*!< rows                                       */
+    int     wpl;        /*!< elements between the starts of two rows    */
+    size_t  capacity;   /*!< elements allocated, if owned               */
+    bool    owned;      /*!< data was allocated by this field           */
+
+    void release() {
+        if (owned)
+            free(data);
+        data = NULL;
+        capacity = 0;
+        owned = false;
+    }
+
+    Field2D(const Field2D &);
+    Field2D &operator=(const Field2D &);
+};
+
+typedef Field2D<double> fieldD;
+typedef Field2D<float> fieldF;
+
+#endif /* Field2D_hpp */
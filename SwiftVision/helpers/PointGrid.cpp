@@ -0,0 +1,122 @@
+#include <math.h>
+#include <algorithm>
+#include "PointGrid.hpp"
+
+/* Cells allowed per indexed point */
+static const int kCellsPerPoint = 4;
+
+int PointGrid::build(const double *xs,
+                     const double *ys,
+                     int n,
+                     double radius) {
+    int i, c, gx, gy;
+    double xmax, ymax;
+
+    nx = ny = 0;
+    start.clear();
+    items.clear();
+    if (!xs || !ys || n < 0 || !(radius >= 0.0))
+        return 1;
+    px.assign(xs, xs + n);
+    py.assign(ys, ys + n);
+    if (n == 0)
+        return 0;
+
+    x0 = xmax = xs[0];
+    y0 = ymax = ys[0];
+    for (i = 1; i < n; i++) {
+        x0 = std::min(x0, xs[i]);
+        xmax = std::max(xmax, xs[i]);
+        y0 = std::min(y0, ys[i]);
+        ymax = std::max(ymax, ys[i]);
+    }
+
+    /* Cells no smaller than radius, and no more of them than
+     * kCellsPerPoint per point */
+    cell = std::max(radius, 1.0);
+    while ((xmax - x0) / cell * ((ymax - y0) / cell) > (double)kCellsPerPoint * n)
+        cell *= 2.0;
+    nx = (int)((xmax - x0) / cell) + 1;
+    ny = (int)((ymax - y0) / cell) + 1;
+
+    /* counting sort of the points by cell */
+    start.assign((size_t)nx * ny + 1, 0);
+    std::vector<int> cells(n);
+    for (i = 0; i < n; i++) {
+        gx = (int)((xs[i] - x0) / cell);
+        gy = (int)((ys[i] - y0) / cell);
+        cells[i] = gy * nx + gx;
+        start[cells[i] + 1]++;
+    }
+    for (c = 0; c < nx * ny; c++)
+        start[c + 1] += start[c];
+    items.resize(n);
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (i = 0; i < n; i++)
+        items[fill[cells[i]]++] = i;
+    return 0;
+}
+
+void PointGrid::query(double x,
+                      double y,
+                      double radius,
+                      std::vector<int> *pindices) const {
+    int gx, gy, gx0, gx1, gy0, gy1, k, i;
+    double dx, dy, r2;
+
+    if (nx == 0)
+        return;
+    gx0 = (int)floor((x - radius - x0) / cell);
+    gx1 = (int)floor((x + radius - x0) / cell);
+    gy0 = (int)floor((y - radius - y0) / cell);
+    gy1 = (int)floor((y + radius - y0) / cell);
+    gx0 = std::max(gx0, 0);
+    gy0 = std::max(gy0, 0);
+    gx1 = std::min(gx1, nx - 1);
+    gy1 = std::min(gy1, ny - 1);
+    r2 = radius * radius;
+    for (gy = gy0; gy <= gy1; gy++) {
+        for (gx = gx0; gx <= gx1; gx++) {
+            for (k = start[gy * nx + gx]; k < start[gy * nx + gx + 1]; k++) {
+                i = items[k];
+                dx = px[i] - x;
+                dy = py[i] - y;
+                if (dx * dx + dy * dy <= r2)
+                    pindices->push_back(i);
+            }
+        }
+    }
+}
+
+int PointGrid::pairsWithin(const double *startx,
+                           const double *starty,
+                           const double *endx,
+                           const double *endy,
+                           int n,
+                           double radius,
+                           std::vector<std::pair<int, int> > *ppairs) {
+    int i, k, j;
+    PointGrid grid;
+    std::vector<int> near;
+
+    if (!ppairs)
+        return 1;
+    ppairs->clear();
+    if (grid.build(startx, starty, n, radius))
+        return 1;
+
+    /* every start near each end; the pair is kept whichever way round
+     * it was found */
+    for (i = 0; i < n; i++) {
+        near.clear();
+        grid.query(endx[i], endy[i], radius, &near);
+        for (k = 0; k < (int)near.size(); k++) {
+            j = near[k];
+            if (j != i)
+                ppairs->push_back(std::make_pair(std::max(i, j), std::min(i, j)));
+        }
+    }
+    std::sort(ppairs->begin(), ppairs->end());
+    ppairs->erase(std::unique(ppairs->begin(), ppairs->end()), ppairs->end());
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef PointGrid_hpp
+#define PointGrid_hpp
+
+#include <utility>
+#include <vector>
+
+/*----------------------------------------------------------------------------*
+ *                           Uniform point grid                               *
+ *                                                                            *
+ *  Buckets n points into square cells at least radius wide, stored like a    *
+ *  counting sort: the points of cell c are items[start[c]] up to             *
+ *  items[start[c + 1]].  Every point within radius of a query lies in the    *
+ *  3 x 3 cells around it, so a query costs the points near it rather than    *
+ *  all n.  The cell size grows past radius when needed to keep the grid      *
+ *  to a few cells per point.                                                 *
+ *                                                                            *
+ *  pairsWithin() finds the pairs the contour edges are built from: contour   *
+ *  j's start point within radius of contour i's end point, in either         *
+ *  direction.                                                                *
+ *----------------------------------------------------------------------------*/
+
+class PointGrid {
+public:
+    PointGrid() : nx(0), ny(0), cell(1.0), x0(0.0), y0(0.0) {}
+
+    /* Indexes the points (xs[i], ys[i]); returns 1 on bad input */
+    int build(const double *xs, const double *ys, int n, double radius);
+
+    /* Appends to pindices the points within radius of (x, y) */
+    void query(double x, double y, double radius, std::vector<int> *pindices) const;
+
+    /* Every pair i > j where j's start is within radius of i's end,
+     * or i's start within radius of j's end, sorted by i then j */
+    static int pairsWithin(const double *startx, const double *starty,
+                           const double *endx, const double *endy,
+                           int n, double radius,
+                           std::vector<std::pair<int, int> > *ppairs);
+
+private:
+    int                 nx, ny;     /*!< cells across and down                  */
+    double              cell;       /*!< cell size                              */
+    double              x0, y0;     /*!< corner of cell 0                       */
+    std::vector<int>    start;      /*!< first item of each cell, and the end   */
+    std::vector<int>    items;      /*!< point indices, by cell                 */
+    std::vector<double> px, py;     /*!< the points, by index                   */
+};
+
+#endif /* PointGrid_hpp */
@@ -135,6 +135,8 @@ namespace dewarp {
                 if (pa->array[i])
                     pa->array[icurrent++] = pa->array[i];
             }
+            for (i = icurrent; i <= imax; i++)  /* clear the vacated tail */
+                pa->array[i] = NULL;
             pa->imax = icurrent - 1;
         }
         return item;
@@ -1,5 +1,22 @@
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DEWARP_AVX2 1
+#define DEWARP_SSE2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DEWARP_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DEWARP_NEON 1
+#endif
 #include "dewarp.hpp"
+#include "parallel.hpp"
+#include "stats.hpp"
+#include "sorting.hpp"
 
 namespace dewarp {
     int join(std::vector<double> *nad,
@@ -33,9 +50,7 @@ namespace dewarp {
     int getMedianVariation(std::vector<double> *na,
                            double *pmedval,
                            double *pmedvar) {
-        int n, i;
-        double val, medval;
-        std::vector<double> *navar;
+        int n;
 
         if (pmedval) *pmedval = 0.0;
         if (!pmedvar)
@@ -43,19 +58,13 @@ namespace dewarp {
         *pmedvar = 0.0;
         if (!na)
             return 1;
-
-        getMedian(na, &medval);
-        if (pmedval) *pmedval = medval;
         n = (int) na->size();
-        navar = new std::vector<double>();
-        for (i = 0; i < n; i++) {
-            val = (*na)[i];
-            navar->push_back(fabs(val - medval));
-        }
-        getMedian(navar, pmedvar);
+        if (n == 0)
+            return 1;
 
-        free(navar);
-        return 0;
+        /* One scratch copy serves both the median and the MAD selection */
+        std::vector<double> scratch(n);
+        return stats::getMedianVariation(na->data(), n, scratch.data(), pmedval, pmedvar);
     }
 
     int getMedian(std::vector<double> *na, double *pval) {
@@ -73,8 +82,8 @@ namespace dewarp {
                      std::vector<double> *nasort,
                      int usebins,
                      double* pval) {
-        int n, index;
-        std::vector<double> *nas;
+        int n, index, nbins;
+        double maxval;
 
         if (!pval)
             return 1;
@@ -88,20 +97,27 @@ namespace dewarp {
             return 1;
 
         if (nasort) {
-            nas = nasort;
-        } else {
-            if (usebins == 0)
-                nas = sort(NULL, na, L_SORT_INCREASING);
-            else
-                nas = binSort(na, L_SORT_INCREASING);
-            if (!nas)
-                return 1;
+            index = (int)(fract * (double)(n - 1) + 0.5);
+            *pval = nasort->at(index);
+            return 0;
         }
-        index = (int)(fract * (double)(n - 1) + 0.5);
-        *pval = nas->at(index);
 
-        if (!nasort) free(nas);
-        return 0;
+        /* Without a presorted array, select the rank directly instead
+         * of sorting the whole input.  For integer valued data, the
+         * rank can be read off the cumulative histogram. */
+        if (usebins == 0) {
+            std::vector<double> scratch(n);
+            return stats::getRankValue(na->data(), n, fract, scratch.data(), pval);
+        }
+
+        getMax(na, &maxval, NULL);
+        nbins = (int)maxval + 1;
+        if (nbins <= 0)
+            return 1;
+        vectorIndex cdf(nbins);
+        if (sorting::binHistogram(na->data(), n, cdf.data(), nbins))
+            return 1;
+        return sorting::histogramRankValue(cdf.data(), nbins, fract, pval);
     }
 
     std::vector<double> *sortByIndex(std::vector<double> *nas,
@@ -144,6 +160,18 @@ namespace dewarp {
             return (std::vector<double> *)NULL;
 
         n = (int)naout->size();
+        if (n < 2)
+            return naout;
+
+        /* Small arrays go through a sorting network */
+        if (n <= SMALL_SORT_MAX) {
+            if (sorting::sortSmall(naout->data(), n, sortorder)) {
+                if (naout != nain)
+                    delete naout;
+                return (std::vector<double> *)NULL;
+            }
+            return naout;
+        }
 
         /* Shell sort */
         for (gap = n/2; gap > 0; gap = gap / 2) {
@@ -166,131 +194,91 @@ namespace dewarp {
 
     std::vector<double> *binSort(std::vector<double> *nas,
                                  int sortorder) {
-        std::vector<double> *nat, *nad;
+        int n, nbins;
+        double maxval;
 
         if (!nas)
             return (std::vector<double> *)NULL;
         if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
             return (std::vector<double> *)NULL;
 
-        nat = getBinSortIndex(nas, sortorder);
-        nad = sortByIndex(nas, nat);
-        free(nat);
-        return nad;
+        n = (int)nas->size();
+        if (n == 0)
+            return new std::vector<double>();
+        getMax(nas, &maxval, NULL);
+        nbins = (int)maxval + 1;
+
+        vectorIndex counts(nbins), index(n);
+        if (sorting::binSortIndex(nas->data(), n, sortorder, counts.data(), nbins, index.data()))
+            return (std::vector<double> *)NULL;
+        return sortByIndex(nas, &index);
     }
 
     std::vector<double> *getBinSortIndex(std::vector<double> *nas,
                                          int sortorder) {
-        int i, n, isize, ival, imax;
-        double size;
-        std::vector<double> *na, *nai, *nad;
-        PtrArray *paindex;
+        int i, n, nbins;
+        double maxval;
+        std::vector<double> *nad;
 
         if (!nas)
             return (std::vector<double> *)NULL;
         if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
             return (std::vector<double> *)NULL;
 
-        /* Set up a ptra holding numa at indices for which there
-         * are values in nas.  Suppose nas has the value 230 at index
-         * 7355.  A numa holding the index 7355 is created and stored
-         * at the ptra index 230.  If there is another value of 230
-         * in nas, its index is added to the same numa (at index 230
-         * in the ptra).  When finished, the ptra can be scanned for numa,
-         * and the original indices in the nas can be read out.  In this
-         * way, the ptra effectively sorts the input numbers in the nas. */
-        getMax(nas, &size, NULL);
-        isize = (int)size;
-
-        paindex = dewarp::ptraCreate(isize + 1);
+        /* Counting sort: the values in nas are used directly as bin
+         * indices, so they must be non-negative integers.  Suppose nas
+         * has the value 230 at index 7355; every index holding 230 ends
+         * up in the output, in input order, right after the indices of
+         * all smaller (or, if decreasing, larger) values. */
         n = (int)nas->size();
-        for (i = 0; i < n; i++) {
-            ival = (*nas)[i];
-            nai = (std::vector<double> *)dewarp::ptraGetPtrToItem(paindex, ival);
-            if (!nai) {  /* make it; no shifting will occur */
-                nai = new std::vector<double>();
-                dewarp::ptraInsert(paindex, ival, nai, L_MIN_DOWNSHIFT);
-            }
-            nai->push_back(i);
-        }
+        if (n == 0)
+            return new std::vector<double>();
+        getMax(nas, &maxval, NULL);
+        nbins = (int)maxval + 1;
 
-        /* Sort by scanning the ptra, extracting numas and pulling
-         * the (index into nas) numbers out of each numa, taken
-         * successively in requested order. */
-        dewarp::ptraGetMaxIndex(paindex, &imax);
-        nad = new std::vector<double>();
-        if (sortorder == L_SORT_INCREASING) {
-            for (i = 0; i <= imax; i++) {
-                na = (std::vector<double> *)dewarp::ptraRemove(paindex, i, L_NO_COMPACTION);
-                if (!na) continue;
-                join(nad, na, 0, -1);
-                free(na);
-            }
-        } else {  /* L_SORT_DECREASING */
-            for (i = imax; i >= 0; i--) {
-                na = (std::vector<double> *)dewarp::ptraRemoveLast(paindex);
-                if (!na) break;  /* they've all been removed */
-                join(nad, na, 0, -1);
-                free(na);
-            }
-        }
+        vectorIndex counts(nbins), index(n);
+        if (sorting::binSortIndex(nas->data(), n, sortorder, counts.data(), nbins, index.data()))
+            return (std::vector<double> *)NULL;
 
-        dewarp::ptraDestroy(&paindex, false, false);
+        nad = new std::vector<double>(n);
+        for (i = 0; i < n; i++)
+            (*nad)[i] = index[i];
         return nad;
     }
 
     std::vector<double> *getSortIndex(std::vector<double> *na,
                                       int sortorder) {
-        int i, n, gap, j;
-        double tmp;
-        std::vector<double> *array;   /* copy of input array */
-        std::vector<double> *iarray;  /* array of indices */
+        int i, n;
+        vectorIndex index;
         std::vector<double> *naisort;
 
-
-        if (!na)
-            return (std::vector<double> *)NULL;
-        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
+        if (getSortIndex(na, sortorder, &index) != 0)
             return (std::vector<double> *)NULL;
 
-        n = (int)na->size();
-        array = new std::vector<double>(*na);
-        if (array == NULL)
-            return (std::vector<double> *)NULL;
-        iarray = new std::vector<double>(n);
-        if (iarray == NULL) {
-            free(array);
-            return (std::vector<double> *)NULL;
-        }
+        n = (int)index.size();
+        naisort = new std::vector<double>(n);
         for (i = 0; i < n; i++)
-            iarray->at(i) = i;
+            (*naisort)[i] = index[i];
+        return naisort;
+    }
 
-        /* Shell sort */
-        for (gap = n/2; gap > 0; gap = gap / 2) {
-            for (i = gap; i < n; i++) {
-                for (j = i - gap; j >= 0; j -= gap) {
-                    double jValue = array->at(j);
-                    double jGapValue = array->at(j + gap);
-                    if ((sortorder == L_SORT_INCREASING && jValue > jGapValue) ||
-                        (sortorder == L_SORT_DECREASING && jValue < jGapValue)) {
-                        tmp = array->at(j);
-                        array->at(j) = array->at(j + gap);
-                        array->at(j + gap) = tmp;
-                        tmp = iarray->at(j);
-                        iarray->at(j) = iarray->at(j + gap);
-                        iarray->at(j + gap) = tmp;
-                    }
-                }
-            }
-        }
+    int getSortIndex(std::vector<double> *na,
+                     int sortorder,
+                     vectorIndex *pindex) {
+        int n;
 
-        naisort = new std::vector<double>();
-        for (i = 0; i < n; i++)
-            naisort->push_back((*iarray)[i]);
+        if (!pindex)
+            return 1;
+        pindex->clear();
+        if (!na)
+            return 1;
+        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
+            return 1;
 
-        free(array);
-        free(iarray);
-        return naisort;
+        n = (int)na->size();
+        pindex->resize(n);
+        vectorIndex scratch(n);
+        return sorting::radixSortIndex(na->data(), n, 1, sortorder, pindex->data(), scratch.data());
     }
 
     int getMin(std::vector<double> *na,
@@ -379,28 +367,24 @@ namespace dewarp {
                               int sorttype,
                               int sortorder,
                               std::vector<double> **pnaindex) {
-        std::vector<DPoint> *ptad;
-        std::vector<double> *naindex;
+        int i, n;
+        vectorIndex index;
 
         if (pnaindex) *pnaindex = NULL;
         if (!ptas)
             return (std::vector<DPoint> *)NULL;
-        if (sorttype != L_SORT_BY_X && sorttype != L_SORT_BY_Y)
-            return (std::vector<DPoint> *)NULL;
-        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
-            return (std::vector<DPoint> *)NULL;
 
-        if (getSortIndex(ptas, sorttype, sortorder, &naindex) != 0)
+        if (getSortIndex(ptas, sorttype, sortorder, &index) != 0)
             return (std::vector<DPoint> *)NULL;
 
-        ptad = sortByIndex(ptas, naindex);
-        if (pnaindex)
-            *pnaindex = naindex;
-        else
-            free(naindex);
-        if (!ptad)
-            return (std::vector<DPoint> *)NULL;
-        return ptad;
+        /* The double valued index is only built if it was asked for */
+        if (pnaindex) {
+            n = (int)index.size();
+            *pnaindex = new std::vector<double>(n);
+            for (i = 0; i < n; i++)
+                (**pnaindex)[i] = index[i];
+        }
+        return sortByIndex(ptas, &index);
     }
 
     int getSortIndex(std::vector<DPoint> *ptas,
@@ -408,12 +392,31 @@ namespace dewarp {
                      int sortorder,
                      std::vector<double> **pnaindex) {
         int i, n;
-        double x, y;
-        std::vector<double> *na;
+        vectorIndex index;
 
         if (!pnaindex)
             return 1;
         *pnaindex = NULL;
+        if (getSortIndex(ptas, sorttype, sortorder, &index) != 0)
+            return 1;
+
+        n = (int)index.size();
+        *pnaindex = new std::vector<double>(n);
+        for (i = 0; i < n; i++)
+            (**pnaindex)[i] = index[i];
+        return 0;
+    }
+
+    int getSortIndex(std::vector<DPoint> *ptas,
+                     int sorttype,
+                     int sortorder,
+                     vectorIndex *pindex) {
+        int n;
+        const double *keys;
+
+        if (!pindex)
+            return 1;
+        pindex->clear();
         if (!ptas)
             return 1;
         if (sorttype != L_SORT_BY_X && sorttype != L_SORT_BY_Y)
@@ -421,27 +424,15 @@ namespace dewarp {
         if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
             return 1;
 
-        /* Build up numa of specific data */
+        /* Sort directly on the x or y field; no key array is built */
         n = (int)ptas->size();
-        na = new std::vector<double>();
-        if (na == NULL)
-            return 1;
-        for (i = 0; i < n; i++) {
-            DPoint p = ptas->at(i);
-            x = p.x;
-            y = p.y;
-            if (sorttype == L_SORT_BY_X)
-                na->push_back(x);
-            else
-                na->push_back(y);
-        }
-
-        /* Get the sort index for data array */
-        *pnaindex = getSortIndex(na, sortorder);
-        free(na);
-        if (!*pnaindex)
-            return 1;
-        return 0;
+        pindex->resize(n);
+        if (n == 0)
+            return 0;
+        keys = (sorttype == L_SORT_BY_X) ? &(*ptas)[0].x : &(*ptas)[0].y;
+        vectorIndex scratch(n);
+        return sorting::radixSortIndex(keys, n, sizeof(DPoint) / sizeof(double), sortorder,
+                                       pindex->data(), scratch.data());
     }
 
     std::vector<DPoint> * sortByIndex(std::vector<DPoint> *ptas,
@@ -468,74 +459,149 @@ namespace dewarp {
         return ptad;
     }
 
-    int addMultConstant(std::vector<std::vector<double>> *fpix,
-                        double addc,
-                        double multc) {
+    std::vector<double> *sortByIndex(std::vector<double> *nas,
+                                     const vectorIndex *index) {
+        int i, n;
+        std::vector<double> *nad;
+
+        if (!nas || !index)
+            return (std::vector<double> *)NULL;
+
+        n = (int)index->size();
+        nad = new std::vector<double>(n);
+        for (i = 0; i < n; i++)
+            (*nad)[i] = (*nas)[(*index)[i]];
+        return nad;
+    }
+
+    std::vector<DPoint> *sortByIndex(std::vector<DPoint> *ptas,
+                                     const vectorIndex *index) {
+        int i, n;
+        std::vector<DPoint> *ptad;
+
+        if (!ptas || !index)
+            return (std::vector<DPoint> *)NULL;
+
+        n = (int)index->size();
+        ptad = new std::vector<DPoint>(n);
+        for (i = 0; i < n; i++)
+            (*ptad)[i] = (*ptas)[(*index)[i]];
+        return ptad;
+    }
+
+    std::vector<std::vector<DPoint>> *sortByIndex(std::vector<std::vector<DPoint>> *ptaas,
+                                                  const vectorIndex *index) {
+        int i, n;
+        std::vector<std::vector<DPoint>> *ptaad;
+
+        if (!ptaas || !index)
+            return (std::vector<std::vector<DPoint>> *)NULL;
+
+        n = (int)ptaas->size();
+        if ((int)index->size() != n)
+            return (std::vector<std::vector<DPoint>> *)NULL;
+        ptaad = new std::vector<std::vector<DPoint>>(n);
+        for (i = 0; i < n; i++)
+            (*ptaad)[i] = (*ptaas)[(*index)[i]];
+        return ptaad;
+    }
+
+    int getMedianVariation(constSpanD na,
+                           Arena *arena,
+                           double *pmedval,
+                           double *pmedvar) {
+        if (pmedval) *pmedval = 0.0;
+        if (!pmedvar)
+            return 1;
+        *pmedvar = 0.0;
+        if (!na.data || na.size <= 0 || !arena)
+            return 1;
+
+        ArenaScope scope(arena);
+        double *scratch = arena->alloc<double>(na.size);
+        if (!scratch)
+            return 1;
+        return stats::getMedianVariation(na.data, na.size, scratch, pmedval, pmedvar);
+    }
+
+    template <typename T>
+    static int addMultConstantField(Field2D<T> *fpix,
+                                    double addc,
+                                    double multc) {
         int i, j, w, h;
+        T *line;
+
         if (!fpix)
             return 1;
 
         if (addc == 0.0 && multc == 1.0)
             return 0;
 
-        h = (int)fpix->size();
-        w = (int)fpix->at(0).size();
-
+        h = fpix->height();
+        w = fpix->width();
         for (i = 0; i < h; i++) {
+            line = fpix->row(i);
             if (addc == 0.0) {
                 for (j = 0; j < w; j++)
-                    fpix->at(i).at(j) *= multc;
+                    line[j] *= multc;
             } else if (multc == 1.0) {
                 for (j = 0; j < w; j++)
-                    fpix->at(i).at(j) += addc;
+                    line[j] += addc;
             } else {
-                for (j = 0; j < w; j++) {
-                    double val = fpix->at(i).at(j);
-                    fpix->at(i).at(j) = multc * val + addc;
-                }
+                for (j = 0; j < w; j++)
+                    line[j] = multc * line[j] + addc;
             }
         }
 
         return 0;
     }
 
-    std::vector<std::vector<double>> *scaleByInteger(std::vector<std::vector<double>> *fpixs,
-                                                     int factor) {
-        int     i, j, k, m, ws, hs, wd, hd, wpls, wpld;
+    int addMultConstant(fieldD *fpix,
+                        double addc,
+                        double multc) {
+        return addMultConstantField(fpix, addc, multc);
+    }
+
+    int addMultConstant(fieldF *fpix,
+                        double addc,
+                        double multc) {
+        return addMultConstantField(fpix, addc, multc);
+    }
+
+    template <typename T>
+    static int scaleByIntegerField(const fieldD *fpixs,
+                                   int factor,
+                                   Field2D<T> *fpixd) {
+        int     i, j, k, m, ws, hs, wd, hd;
         double   val0, val1, val2, val3;
-        double  *datas, *datad, *lines, *lined, *fract;
-        std::vector<std::vector<double>> *fpixd;
+        const double *lines, *linesn;
+        T       *lined;
 
-        if (!fpixs)
-            return (std::vector<std::vector<double>> *)NULL;
-        hs = (int)fpixs->size();
-        ws = (int)fpixs->at(0).size();
+        if (!fpixs || !fpixd || factor < 1)
+            return 1;
+        hs = fpixs->height();
+        ws = fpixs->width();
+        if (hs < 1 || ws < 1)
+            return 1;
 
         hd = factor * (hs - 1) + 1;
         wd = factor * (ws - 1) + 1;
+        if (fpixd->resize(wd, hd))
+            return 1;
 
-        datas = (double *)calloc(hs * ws, sizeof(double));
-        datad = (double *)calloc(hd * wd, sizeof(double));
-        for (int i = 0; i < hs; i++) {
-            for (int j = 0; j < ws; j++) {
-                datas[i * ws + j] = (*fpixs)[i][j];
-            }
-        }
-
-        wpls = ws; /* 4-byte words */
-        wpld = wd; /* 4-byte words */
-        fract = (double *)calloc(factor, sizeof(double));
+        std::vector<double> fract(factor);
         for (i = 0; i < factor; i++)
             fract[i] = i / (double)factor;
         for (i = 0; i < hs - 1; i++) {
-            lines = datas + i * wpls;
+            lines = fpixs->row(i);
+            linesn = fpixs->row(i + 1);
             for (j = 0; j < ws - 1; j++) {
                 val0 = lines[j];
                 val1 = lines[j + 1];
-                val2 = lines[wpls + j];
-                val3 = lines[wpls + j + 1];
+                val2 = linesn[j];
+                val3 = linesn[j + 1];
                 for (k = 0; k < factor; k++) {  /* rows of sub-block */
-                    lined = datad + (i * factor + k) * wpld;
+                    lined = fpixd->row(i * factor + k);
                     for (m = 0; m < factor; m++) {  /* cols of sub-block */
                         lined[j * factor + m] =
                         val0 * (1.0 - fract[m]) * (1.0 - fract[k]) +
@@ -549,37 +615,140 @@ namespace dewarp {
 
         /* Do the right-most column of fpixd, skipping LR corner */
         for (i = 0; i < hs - 1; i++) {
-            lines = datas + i * wpls;
-            val0 = lines[ws - 1];
-            val1 = lines[wpls + ws - 1];
+            val0 = fpixs->row(i)[ws - 1];
+            val1 = fpixs->row(i + 1)[ws - 1];
             for (k = 0; k < factor; k++) {
-                lined = datad + (i * factor + k) * wpld;
+                lined = fpixd->row(i * factor + k);
                 lined[wd - 1] = val0 * (1.0 - fract[k]) + val1 * fract[k];
             }
         }
 
         /* Do the bottom-most row of fpixd */
-        lines = datas + (hs - 1) * wpls;
-        lined = datad + (hd - 1) * wpld;
+        lines = fpixs->row(hs - 1);
+        lined = fpixd->row(hd - 1);
         for (j = 0; j < ws - 1; j++) {
             val0 = lines[j];
             val1 = lines[j + 1];
             for (m = 0; m < factor; m++)
                 lined[j * factor + m] = val0 * (1.0 - fract[m]) + val1 * fract[m];
-            lined[wd - 1] = lines[ws - 1];  /* LR corner */
         }
+        lined[wd - 1] = lines[ws - 1];  /* LR corner */
 
-        free(fract);
-        free(datas);
+        return 0;
+    }
 
-        fpixd = new std::vector<std::vector<double>>(hd, std::vector<double>(wd));
-        for (int i = 0; i < hd; i++) {
-            for (int j = 0; j < wd; j++) {
-                (*fpixd)[i][j] = datad[i * wd + j];
-            }
+    int scaleByInteger(const fieldD *fpixs,
+                       int factor,
+                       fieldD *fpixd) {
+        return scaleByIntegerField(fpixs, factor, fpixd);
+    }
+
+    /* out[m] = v0 + dv * fract[m], m = 0 ... n - 1 */
+    static inline void rampFloat(float v0,
+                                 float dv,
+                                 const float *fract,
+                                 int n,
+                                 float *out) {
+        int m = 0;
+#if defined(DEWARP_AVX2)
+        __m256 v0x8 = _mm256_set1_ps(v0), dvx8 = _mm256_set1_ps(dv);
+        for (; m + 8 <= n; m += 8)
+            _mm256_storeu_ps(out + m, _mm256_add_ps(v0x8, _mm256_mul_ps(dvx8, _mm256_loadu_ps(fract + m))));
+#endif
+#if defined(DEWARP_SSE2)
+        __m128 v0x4 = _mm_set1_ps(v0), dvx4 = _mm_set1_ps(dv);
+        for (; m + 4 <= n; m += 4)
+            _mm_storeu_ps(out + m, _mm_add_ps(v0x4, _mm_mul_ps(dvx4, _mm_loadu_ps(fract + m))));
+#elif defined(DEWARP_NEON)
+        float32x4_t v0x4 = vdupq_n_f32(v0), dvx4 = vdupq_n_f32(dv);
+        for (; m + 4 <= n; m += 4)
+            vst1q_f32(out + m, vmlaq_f32(v0x4, dvx4, vld1q_f32(fract + m)));
+#endif
+        for (; m < n; m++)
+            out[m] = v0 + dv * fract[m];
+    }
+
+    /* out[j] = a[j] + (b[j] - a[j]) * f, j = 0 ... n - 1 */
+    static inline void blendRows(const float *a,
+                                 const float *b,
+                                 float f,
+                                 int n,
+                                 float *out) {
+        int j = 0;
+#if defined(DEWARP_SSE2)
+        __m128 fx4 = _mm_set1_ps(f);
+        for (; j + 4 <= n; j += 4) {
+            __m128 va = _mm_loadu_ps(a + j);
+            _mm_storeu_ps(out + j, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + j), va), fx4)));
+        }
+#elif defined(DEWARP_NEON)
+        float32x4_t fx4 = vdupq_n_f32(f);
+        for (; j + 4 <= n; j += 4) {
+            float32x4_t va = vld1q_f32(a + j);
+            vst1q_f32(out + j, vmlaq_f32(va, vsubq_f32(vld1q_f32(b + j), va), fx4));
         }
-        free(datad);
+#endif
+        for (; j < n; j++)
+            out[j] = a[j] + (b[j] - a[j]) * f;
+    }
+
+    int scaleByInteger(const fieldF *fpixs,
+                       int factor,
+                       fieldF *fpixd) {
+        int i, ws, hs, wd, hd;
+
+        if (!fpixs || !fpixd || factor < 1)
+            return 1;
+        hs = fpixs->height();
+        ws = fpixs->width();
+        if (hs < 1 || ws < 1)
+            return 1;
+
+        hd = factor * (hs - 1) + 1;
+        wd = factor * (ws - 1) + 1;
+        if (fpixd->resize(wd, hd))
+            return 1;
 
-        return fpixd;
+        std::vector<float> fract(factor);
+        for (i = 0; i < factor; i++)
+            fract[i] = i / (float)factor;
+
+        /* The bilinear blend is separable: each output row first blends
+         * the two source rows around it, then ramps linearly across
+         * every source cell.  Rows are independent, so they are split
+         * across threads, each with its own blended row. */
+        parallel::forRange(hd, 64, [&](int begin, int end) {
+            int r, j, is, k;
+            std::vector<float> blended(ws);
+            for (r = begin; r < end; r++) {
+                is = r / factor;
+                k = r - is * factor;
+                if (k == 0 || is + 1 >= hs)
+                    memcpy(blended.data(), fpixs->row(is), ws * sizeof(float));
+                else
+                    blendRows(fpixs->row(is), fpixs->row(is + 1), fract[k], ws, blended.data());
+
+                float *lined = fpixd->row(r);
+                for (j = 0; j < ws - 1; j++)
+                    rampFloat(blended[j], blended[j + 1] - blended[j], fract.data(), factor, lined + j * factor);
+                lined[wd - 1] = blended[ws - 1];
+            }
+        });
+        return 0;
+    }
+
+    int scaleByInteger(const fieldD *fpixs,
+                       int factor,
+                       fieldF *fpixd) {
+        int i, j;
+
+        if (!fpixs)
+            return 1;
+        /* The grid is small; convert it once and take the float path */
+        fieldF grid(fpixs->width(), fpixs->height());
+        for (i = 0; i < fpixs->height(); i++)
+            for (j = 0; j < fpixs->width(); j++)
+                grid.at(i, j) = (float)fpixs->at(i, j);
+        return scaleByInteger(&grid, factor, fpixd);
     }
 }
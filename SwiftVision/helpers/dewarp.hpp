@@ -5,6 +5,8 @@
 #include <vector>
 #include <cassert>
 #import "DataTypes.h"
+#import "Arena.hpp"
+#import "Field2D.hpp"
 
 /*----------------------------------------------------------------------------*
  *                              Sort flags                                    *
@@ -69,6 +71,21 @@ namespace dewarp {
     std::vector<double> *sortByIndex(std::vector<double>*nas,
                                      std::vector<double>*naindex);
 
+    /* Typed permutation API; index sorts are stable */
+    int getSortIndex(std::vector<DPoint> *ptas,
+                     int sorttype,
+                     int sortorder,
+                     vectorIndex *pindex);
+    int getSortIndex(std::vector<double> *na,
+                     int sortorder,
+                     vectorIndex *pindex);
+    std::vector<double> *sortByIndex(std::vector<double> *nas,
+                                     const vectorIndex *index);
+    std::vector<DPoint> *sortByIndex(std::vector<DPoint> *ptas,
+                                     const vectorIndex *index);
+    std::vector<std::vector<DPoint>> *sortByIndex(std::vector<std::vector<DPoint>> *ptaas,
+                                                  const vectorIndex *index);
+
     std::vector<double> *binSort(std::vector<double> *nas,
                                  int sortorder);
 
@@ -78,11 +95,37 @@ namespace dewarp {
     std::vector<double> *getSortIndex(std::vector<double> *na,
                                       int sortorder);
 
-    int addMultConstant(std::vector<std::vector<double>> *fpix,
+    /* Allocation free variant: the input is a read-only span, and the
+     * scratch space comes from the arena, which is rewound before
+     * returning. */
+    int getMedianVariation(constSpanD na,
+                           Arena *arena,
+                           double *pmedval,
+                           double *pmedvar);
+
+    /* scaleByInteger writes the (factor * (w - 1) + 1) x
+     * (factor * (h - 1) + 1) interpolated field straight into fpixd,
+     * which is resized as needed; a float destination halves the size
+     * of full resolution maps.  The float destinations use a separable,
+     * vectorized and multi-threaded float32 blend that matches the
+     * double version to within 1e-6 of the largest magnitude in the
+     * field (a few float ulps).  The dewarp itself no longer expands
+     * the grid (remap.hpp warps from it directly), so only the
+     * benchmarks call the float variants today. */
+    int addMultConstant(fieldD *fpix,
                         double addc,
                         double multc);
-
-    std::vector<std::vector<double>> *scaleByInteger(std::vector<std::vector<double>> *fpixs,
-                                                     int factor);
+    int addMultConstant(fieldF *fpix,
+                        double addc,
+                        double multc);
+    int scaleByInteger(const fieldD *fpixs,
+                       int factor,
+                       fieldD *fpixd);
+    int scaleByInteger(const fieldD *fpixs,
+                       int factor,
+                       fieldF *fpixd);
+    int scaleByInteger(const fieldF *fpixs,
+                       int factor,
+                       fieldF *fpixd);
 }
 #endif /* dewarp_hpp */
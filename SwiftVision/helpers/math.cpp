@@ -1,10 +1,21 @@
 #include <math.h>
 #include "math.hpp"
 #include "dewarp.hpp"
+#include "stats.hpp"
+#include "parallel.hpp"
 
 #define  SWAP(a,b)   {temp = (a); (a) = (b); (b) = temp;}
 
 namespace math {
+    /* Multiply-adds a chunk of a parallel loop should have at least,
+     * so the thread it may start pays for itself */
+    static const int kMinChunkWork = 1 << 15;
+
+    /* Grain, in items, for a loop doing about work multiply-adds per item */
+    static inline int chunkGrain(int work) {
+        return std::max(1, kMinChunkWork / std::max(work, 1));
+    }
+
     int gaussjordan(double **a,
                     double *b,
                     int n) {
@@ -102,15 +113,72 @@ namespace math {
         return abs(diff);
     }
 
+    /* A fit whose normal determinant is below this, relative to n^2,
+     * has fewer than three distinct x values. */
+    static const double kSingularQuadratic = 1.0e-10;
+
+    /* Solves the normal equations of y = a x^2 + b x + c from the
+     * centered moments of a point set:
+     *     n, mx, my     number of points (or total weight) and means
+     *     r2, r3, r4    sum of (x - mx)^k
+     *     p1, p2        sum of (x - mx)^k * (y - my)
+     * In u = (x - mx) / s, with s^2 = r2 / n, sum(u) = 0 and sum(u^2) = n,
+     * so fitting y - my = A u^2 + B u + C reduces to
+     *     | s4  s3  n |  |A|   |t2|
+     *     | s3  n   0 |  |B| = |t1|
+     *     | n   0   n |  |C|   |0 |
+     * with the closed form solution
+     *     A = (n t2 - s3 t1) / D,   B = ((s4 - n) t1 - s3 t2) / D,   C = -A
+     *     D = n s4 - s3^2 - n^2
+     * Centering and scaling keep the system well conditioned for pixel
+     * coordinates, where x^4 is otherwise ~1e13.  There are no branches
+     * on the data, so a loop over many fits vectorizes.  Returns 1, with
+     * zero coefficients, when the fit is underdetermined; with fewer than
+     * three distinct x values D is zero to rounding. */
+    static inline int solveQuadratic(double n,
+                                     double mx,
+                                     double my,
+                                     double r2,
+                                     double r3,
+                                     double r4,
+                                     double p1,
+                                     double p2,
+                                     double *pa,
+                                     double *pb,
+                                     double *pc) {
+        double q, s, s3, s4, t1, t2, det, a, b, ca, cb;
+        int ok;
+
+        ok = n > 0.0 && r2 > 0.0;
+        q = ok ? r2 / n : 1.0;
+        s = sqrt(q);
+        s3 = r3 / (q * s);
+        s4 = r4 / (q * q);
+        t1 = p1 / s;
+        t2 = p2 / q;
+        det = n * s4 - s3 * s3 - n * n;
+        ok = ok && det > kSingularQuadratic * n * n;
+        det = ok ? det : 1.0;
+        ca = (n * t2 - s3 * t1) / det;
+        cb = ((s4 - n) * t1 - s3 * t2) / det;
+
+        /* back to y = a x^2 + b x + c */
+        a = ca / q;
+        b = cb / s - 2.0 * a * mx;
+        *pa = ok ? a : 0.0;
+        *pb = ok ? b : 0.0;
+        *pc = ok ? my - ca + a * mx * mx - cb * mx / s : 0.0;
+        return ok ? 0 : 1;
+    }
+
     int getQuadraticLSF(vectorPointD *pta,
                         double *pa,
                         double *pb,
                         double *pc,
                         std::vector<double> **pnafit) {
-        int n = 0, i, ret;
-        double x, y, sx, sy, sx2, sx3, sx4, sxy, sx2y;
-        double *f[3];
-        double g[3];
+        int n = 0, i;
+        double x, y, mx, my, d, d2, e, r2, r3, r4, p1, p2;
+        double a, b, c;
 
         if (pa) *pa = 0.0;
         if (pb) *pb = 0.0;
@@ -124,53 +192,39 @@ namespace math {
             return 1;
 
         n = (int)pta->size();
-        sx = sy = sx2 = sx3 = sx4 = sxy = sx2y = 0.;
+        mx = my = 0.;
         for (i = 0; i < n; i++) {
-            DPoint p = pta->at(i); /* not a copy */
-            x = p.x;
-            y = p.y;
-            sx += x;
-            sy += y;
-            sx2 += x * x;
-            sx3 += x * x * x;
-            sx4 += x * x * x * x;
-            sxy += x * y;
-            sx2y += x * x * y;
+            mx += (*pta)[i].x;
+            my += (*pta)[i].y;
         }
+        mx /= n;
+        my /= n;
 
-        for (i = 0; i < 3; i++)
-            f[i] = (double *)calloc(3, sizeof(double));
-        f[0][0] = sx4;
-        f[0][1] = sx3;
-        f[0][2] = sx2;
-        f[1][0] = sx3;
-        f[1][1] = sx2;
-        f[1][2] = sx;
-        f[2][0] = sx2;
-        f[2][1] = sx;
-        f[2][2] = n;
-        g[0] = sx2y;
-        g[1] = sxy;
-        g[2] = sy;
-
-        /* Solve for the unknowns, also putting f-inverse into f */
-        ret = gaussjordan(f, g, 3);
-        for (i = 0; i < 3; i++)
-            free(f[i]);
-        if (ret)
+        r2 = r3 = r4 = p1 = p2 = 0.;
+        for (i = 0; i < n; i++) {
+            d = (*pta)[i].x - mx;
+            e = (*pta)[i].y - my;
+            d2 = d * d;
+            r2 += d2;
+            r3 += d2 * d;
+            r4 += d2 * d2;
+            p1 += d * e;
+            p2 += d2 * e;
+        }
+        if (solveQuadratic(n, mx, my, r2, r3, r4, p1, p2, &a, &b, &c))
             return 1;
 
-        if (pa) *pa = g[0];
-        if (pb) *pb = g[1];
-        if (pc) *pc = g[2];
+        if (pa) *pa = a;
+        if (pb) *pb = b;
+        if (pc) *pc = c;
         if (pnafit) {
 
             *pnafit = new std::vector<double>(n);
             for (i = 0; i < n; i++) {
                 DPoint p = pta->at(i); /* not a copy */
                 x = p.x;
-                y = g[0] * x * x + g[1] * x + g[2];
-                (*pnafit)->push_back(y);
+                y = a * x * x + b * x + c;
+                (**pnafit)[i] = y;
             }
         }
         return 0;
@@ -183,7 +237,6 @@ namespace math {
                            double *pmederr) {
         int    i, n;
         double  x, c0, c1, c2;
-        std::vector<double> *naerr;
 
         if (pmederr) *pmederr = 0.0;
         if (!pa || !pb || !pc)
@@ -201,18 +254,206 @@ namespace math {
         /* Optionally, find the median error */
         if (pmederr) {
             n = (int)ptad->size();
-            naerr = new std::vector<double>();
+            std::vector<double> errors(n);
             for (i = 0; i < n; i++) {
-                DPoint p = ptad->at(i);
+                DPoint p = (*ptad)[i];
                 applyQuadraticFit(c2, c1, c0, p.x, &x);
-                naerr->push_back(abs(x-p.y));
+                errors[i] = fabs(x - p.y);
+            }
+            /* the errors are ours; select the median in place */
+            stats::getMedian(errors.data(), n, errors.data(), pmederr);
+        }
+        return 0;
+    }
+
+    /* Tukey biweight tuning constant, in units of the residual scale */
+    static const double kTukeyC = 4.685;
+    /* Floor on the residual scale, in pixels, so that perfectly aligned
+     * end points don't turn every other point into an outlier */
+    static const double kMinResidualScale = 1.0;
+    /* Iteration stops once the fit moves less than this, in pixels */
+    static const double kRobustTolerance = 0.05;
+
+    /* Fits y = c[0] x^2 + c[1] x + c[2] to n points by iteratively
+     * reweighted least squares with Tukey's biweight.  The start is the
+     * constant fit through the median, so an outlier never pulls the
+     * first estimate; the scale is 1.4826 times the median absolute
+     * residual.  weights (n) receives the final weights and scratch
+     * needs n doubles. */
+    static int robustQuadraticLSF(const DPoint *pta,
+                                  int n,
+                                  int maxiters,
+                                  double *weights,
+                                  double *scratch,
+                                  double *pcoeffs,
+                                  int *pniters) {
+        int i, iter;
+        double a, b, c, na, nb, nc, fit, r, scale, w, u;
+        double sw, mx, my, d, d2, e, r2, r3, r4, p1, p2, xmin, xmax, shift;
+
+        *pniters = 0;
+        if (!pta || n < 3)
+            return 1;
+
+        for (i = 0; i < n; i++)
+            scratch[i] = pta[i].y;
+        stats::getMedian(scratch, n, scratch, &c);
+        a = b = 0.0;
+        xmin = xmax = pta[0].x;
+        for (i = 1; i < n; i++) {
+            xmin = min(xmin, pta[i].x);
+            xmax = max(xmax, pta[i].x);
+        }
+
+        for (iter = 0; iter < maxiters; iter++) {
+            /* robust scale of the current residuals */
+            for (i = 0; i < n; i++) {
+                fit = (a * pta[i].x + b) * pta[i].x + c;
+                scratch[i] = fabs(pta[i].y - fit);
             }
-            dewarp::getMedian(naerr, pmederr);
-            free(naerr);
+            stats::getMedian(scratch, n, scratch, &scale);
+            scale = max(1.4826 * scale, kMinResidualScale);
+
+            /* biweights and the weighted centered moments */
+            sw = mx = my = 0.0;
+            for (i = 0; i < n; i++) {
+                fit = (a * pta[i].x + b) * pta[i].x + c;
+                r = pta[i].y - fit;
+                u = r / (kTukeyC * scale);
+                w = (fabs(u) < 1.0) ? (1.0 - u * u) * (1.0 - u * u) : 0.0;
+                weights[i] = w;
+                sw += w;
+                mx += w * pta[i].x;
+                my += w * pta[i].y;
+            }
+            if (sw <= 0.0)
+                break;
+            mx /= sw;
+            my /= sw;
+            r2 = r3 = r4 = p1 = p2 = 0.0;
+            for (i = 0; i < n; i++) {
+                w = weights[i];
+                d = pta[i].x - mx;
+                e = pta[i].y - my;
+                d2 = d * d;
+                r2 += w * d2;
+                r3 += w * d2 * d;
+                r4 += w * d2 * d2;
+                p1 += w * d * e;
+                p2 += w * d2 * e;
+            }
+            if (solveQuadratic(sw, mx, my, r2, r3, r4, p1, p2, &na, &nb, &nc))
+                break;  /* too few inliers left; keep the last fit */
+
+            /* largest change of the fit over the span of the points */
+            shift = 0.0;
+            for (i = 0; i < 3; i++) {
+                d = xmin + 0.5 * i * (xmax - xmin);
+                shift = max(shift, fabs((na - a) * d * d + (nb - b) * d + (nc - c)));
+            }
+            a = na;
+            b = nb;
+            c = nc;
+            *pniters = iter + 1;
+            if (shift < kRobustTolerance)
+                break;
         }
+
+        pcoeffs[0] = a;
+        pcoeffs[1] = b;
+        pcoeffs[2] = c;
         return 0;
     }
 
+    /* Both margin fits, on end points in plain arrays; the inliers are
+     * copied out to pptal2 and pptar2 when they are given. */
+    static int robustMarginLSF(const DPoint *ptal,
+                               int nl,
+                               const DPoint *ptar,
+                               int nr,
+                               int maxiters,
+                               Arena *arena,
+                               double *pcl,
+                               double *pcr,
+                               vectorPointD **pptal2,
+                               vectorPointD **pptar2,
+                               int *pniters) {
+        int i, j, nmax, niters, ret;
+        double *weights, *scratch;
+        const DPoint *ptas[2] = { ptal, ptar };
+        int ns[2] = { nl, nr };
+        vectorPointD **pptas2[2] = { pptal2, pptar2 };
+        double *coeffs[2] = { pcl, pcr };
+
+        if (pptal2) *pptal2 = NULL;
+        if (pptar2) *pptar2 = NULL;
+        if (pniters) *pniters = 0;
+        if (!ptal || !ptar || !pcl || !pcr || !arena)
+            return 1;
+        for (j = 0; j < 3; j++)
+            pcl[j] = pcr[j] = 0.0;
+        if (maxiters < 1)
+            maxiters = 1;
+
+        ArenaScope scope(arena);
+        nmax = max(max(nl, nr), 1);
+        weights = arena->alloc<double>(nmax);
+        scratch = arena->alloc<double>(nmax);
+        if (!weights || !scratch)
+            return 1;
+
+        ret = 0;
+        for (j = 0; j < 2; j++) {
+            if (robustQuadraticLSF(ptas[j], ns[j], maxiters, weights, scratch, coeffs[j], &niters)) {
+                ret = 1;
+                continue;
+            }
+            if (pniters)
+                *pniters = max(*pniters, niters);
+
+            /* the points with zero weight are the outliers */
+            if (pptas2[j]) {
+                *pptas2[j] = new vectorPointD();
+                for (i = 0; i < ns[j]; i++) {
+                    if (weights[i] > 0.0)
+                        (*pptas2[j])->push_back(ptas[j][i]);
+                }
+            }
+        }
+        return ret;
+    }
+
+    int dewarpRobustMarginLSF(vectorPointD *ptal,
+                              vectorPointD *ptar,
+                              int maxiters,
+                              Arena *arena,
+                              double *pcl,
+                              double *pcr,
+                              vectorPointD **pptal2,
+                              vectorPointD **pptar2,
+                              int *pniters) {
+        if (!ptal || !ptar) {
+            if (pptal2) *pptal2 = NULL;
+            if (pptar2) *pptar2 = NULL;
+            if (pniters) *pniters = 0;
+            return 1;
+        }
+        return robustMarginLSF(ptal->data(), (int)ptal->size(), ptar->data(), (int)ptar->size(),
+                               maxiters, arena, pcl, pcr, pptal2, pptar2, pniters);
+    }
+
+    int dewarpRobustMarginLSF(const DPoint *ptal,
+                              int nl,
+                              const DPoint *ptar,
+                              int nr,
+                              int maxiters,
+                              Arena *arena,
+                              double *pcl,
+                              double *pcr,
+                              int *pniters) {
+        return robustMarginLSF(ptal, nl, ptar, nr, maxiters, arena, pcl, pcr, NULL, NULL, pniters);
+    }
+
     int applyQuadraticFit(double a,
                           double b,
                           double c,
@@ -304,16 +545,288 @@ namespace math {
         return 0;
     }
 
-    double polyval(std::vector<double> p, double x) {
-        double output = 0;
-        double polyCnt = p.size();
-        for (int i = 0; i < polyCnt; i++) {
-            output += p[i] * pow(x, (polyCnt-1)-i);
+    int getQuadraticLSFBatch(const double *xs,
+                             const double *ys,
+                             const int *offsets,
+                             int nfits,
+                             Arena *arena,
+                             double *pa,
+                             double *pb,
+                             double *pc,
+                             double *perr) {
+        int npts;
+
+        if (!xs || !ys || !offsets || !arena)
+            return 1;
+        if (!pa || !pb || !pc)
+            return 1;
+        if (nfits <= 0)
+            return 0;
+
+        /* One SoA array per moment */
+        ArenaScope scope(arena);
+        double *moments = arena->alloc<double>(9 * nfits);
+        if (!moments)
+            return 1;
+        double *mn = moments, *mmx = mn + nfits, *mmy = mmx + nfits;
+        double *mr2 = mmy + nfits, *mr3 = mr2 + nfits, *mr4 = mr3 + nfits;
+        double *mp1 = mr4 + nfits, *mp2 = mp1 + nfits, *mfail = mp2 + nfits;
+
+        /* Gather the centered moments of every set, solve its normal
+         * equations and find its residual.  The sets are independent,
+         * so runs of them go to separate threads; each writes only its
+         * own slots. */
+        npts = offsets[nfits] - offsets[0];
+        parallel::forRange(nfits, chunkGrain(npts / nfits), [&](int begin, int end) {
+            int i, k, lo, hi;
+            double n, mx, my, d, d2, e, r2, r3, r4, p1, p2, ss, val;
+
+            for (k = begin; k < end; k++) {
+                lo = offsets[k];
+                hi = offsets[k + 1];
+                n = (double)(hi - lo);
+                mx = my = 0.;
+                for (i = lo; i < hi; i++) {
+                    mx += xs[i];
+                    my += ys[i];
+                }
+                mx = (hi > lo) ? mx / n : 0.0;
+                my = (hi > lo) ? my / n : 0.0;
+
+                r2 = r3 = r4 = p1 = p2 = 0.;
+                for (i = lo; i < hi; i++) {
+                    d = xs[i] - mx;
+                    e = ys[i] - my;
+                    d2 = d * d;
+                    r2 += d2;
+                    r3 += d2 * d;
+                    r4 += d2 * d2;
+                    p1 += d * e;
+                    p2 += d2 * e;
+                }
+                mn[k] = n;
+                mmx[k] = mx;
+                mmy[k] = my;
+                mr2[k] = r2;
+                mr3[k] = r3;
+                mr4[k] = r4;
+                mp1[k] = p1;
+                mp2[k] = p2;
+            }
+
+            /* Solve the normal equations of the run */
+            for (k = begin; k < end; k++) {
+                mfail[k] = (double)solveQuadratic(mn[k], mmx[k], mmy[k], mr2[k], mr3[k], mr4[k],
+                                                  mp1[k], mp2[k], &pa[k], &pb[k], &pc[k]);
+            }
+
+            if (perr) {
+                for (k = begin; k < end; k++) {
+                    ss = 0.;
+                    for (i = offsets[k]; i < offsets[k + 1]; i++) {
+                        val = (pa[k] * xs[i] + pb[k]) * xs[i] + pc[k] - ys[i];
+                        ss += val * val;
+                    }
+                    perr[k] = (mfail[k] != 0.0) ? -1.0 : sqrt(ss / mn[k]);
+                }
+            }
+        });
+        return 0;
+    }
+
+    int getLinearLSFBatch(const double *xs,
+                          const double *ys,
+                          const int *offsets,
+                          int nfits,
+                          double *pa,
+                          double *pb,
+                          double *perr) {
+        int i, k, lo, hi, ok;
+        double n, mx, my, d, r2, p1, ss, val;
+
+        if (!xs || !ys || !offsets)
+            return 1;
+        if (!pa || !pb)
+            return 1;
+
+        /* With centered x the 2x2 normal system is diagonal:
+         *     a = sum(dx * dy) / sum(dx^2),   b = my - a * mx */
+        for (k = 0; k < nfits; k++) {
+            lo = offsets[k];
+            hi = offsets[k + 1];
+            n = (double)(hi - lo);
+            mx = my = 0.;
+            for (i = lo; i < hi; i++) {
+                mx += xs[i];
+                my += ys[i];
+            }
+            mx = (hi > lo) ? mx / n : 0.0;
+            my = (hi > lo) ? my / n : 0.0;
+
+            r2 = p1 = 0.;
+            for (i = lo; i < hi; i++) {
+                d = xs[i] - mx;
+                r2 += d * d;
+                p1 += d * (ys[i] - my);
+            }
+            ok = n >= 2.0 && r2 > 0.0;
+            pa[k] = ok ? p1 / r2 : 0.0;
+            pb[k] = ok ? my - pa[k] * mx : 0.0;
+
+            if (perr) {
+                ss = 0.;
+                for (i = lo; i < hi; i++) {
+                    val = pa[k] * xs[i] + pb[k] - ys[i];
+                    ss += val * val;
+                }
+                perr[k] = ok ? sqrt(ss / n) : -1.0;
+            }
         }
+        return 0;
+    }
+
+    int getQuadraticLSFColumns(const double *xs,
+                               int n,
+                               const double *ys,
+                               int stride,
+                               int nfits,
+                               double *pa,
+                               double *pb,
+                               double *pc,
+                               double *perr) {
+        int i;
+        double mx, d, d2, r2, r3, r4;
+
+        if (!xs || !ys || !pa || !pb || !pc)
+            return 1;
+        if (n <= 0 || nfits <= 0 || stride < nfits)
+            return 1;
+
+        /* The abscissae are shared, so their moments are found once */
+        mx = 0.;
+        for (i = 0; i < n; i++)
+            mx += xs[i];
+        mx /= n;
+        r2 = r3 = r4 = 0.;
+        for (i = 0; i < n; i++) {
+            d = xs[i] - mx;
+            d2 = d * d;
+            r2 += d2;
+            r3 += d2 * d;
+            r4 += d2 * d2;
+        }
+
+        /* Accumulate sum(y), sum(d y) and sum(d^2 y) of every column in
+         * pc, pb and pa, a row at a time so the inner loop runs along
+         * contiguous memory across the fits.  Each thread takes a slice
+         * of the columns through all of the rows. */
+        std::atomic<int> fail(0);
+        parallel::forRange(nfits, chunkGrain(n), [&](int begin, int end) {
+            int i, j, failed;
+            double d, d2, my, val;
+            const double *row;
+
+            for (j = begin; j < end; j++)
+                pa[j] = pb[j] = pc[j] = 0.;
+            for (i = 0; i < n; i++) {
+                d = xs[i] - mx;
+                d2 = d * d;
+                row = ys + (size_t)i * stride;
+                for (j = begin; j < end; j++) {
+                    pc[j] += row[j];
+                    pb[j] += d * row[j];
+                    pa[j] += d2 * row[j];
+                }
+            }
+
+            /* sum(d (y - my)) = sum(d y), since sum(d) = 0 */
+            failed = 0;
+            for (j = begin; j < end; j++) {
+                my = pc[j] / n;
+                failed |= solveQuadratic(n, mx, my, r2, r3, r4, pb[j], pa[j] - my * r2,
+                                         &pa[j], &pb[j], &pc[j]);
+            }
+            if (failed)
+                fail = 1;
+
+            if (perr) {
+                for (j = begin; j < end; j++)
+                    perr[j] = 0.;
+                for (i = 0; i < n; i++) {
+                    row = ys + (size_t)i * stride;
+                    for (j = begin; j < end; j++) {
+                        val = (pa[j] * xs[i] + pb[j]) * xs[i] + pc[j] - row[j];
+                        perr[j] += val * val;
+                    }
+                }
+            }
+        });
+
+        if (perr) {
+            for (int j = 0; j < nfits; j++)
+                perr[j] = fail ? -1.0 : sqrt(perr[j] / n);
+        }
+        return fail;
+    }
+
+    int evaluateQuadraticRows(const double *pa,
+                              const double *pb,
+                              const double *pc,
+                              int nfits,
+                              double x0,
+                              double dx,
+                              int n,
+                              double *pd,
+                              int stride) {
+        if (!pa || !pb || !pc || !pd || nfits < 0 || n < 0 || stride < n)
+            return 1;
+
+        parallel::forRange(nfits, chunkGrain(n), [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                double *line = pd + (size_t)k * stride;
+                for (int i = 0; i < n; i++) {
+                    double x = x0 + i * dx;
+                    line[i] = (pa[k] * x + pb[k]) * x + pc[k];
+                }
+            }
+        });
+        return 0;
+    }
+
+    int evaluateQuadraticColumns(const double *pa,
+                                 const double *pb,
+                                 const double *pc,
+                                 int nfits,
+                                 double x0,
+                                 double dx,
+                                 int n,
+                                 double *pd,
+                                 int stride) {
+        if (!pa || !pb || !pc || !pd || nfits < 0 || n < 0 || stride < nfits)
+            return 1;
+
+        /* Row i holds every fit at the same x, so it is written in
+         * one contiguous sweep */
+        parallel::forRange(n, chunkGrain(nfits), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                double x = x0 + i * dx;
+                double *line = pd + (size_t)i * stride;
+                for (int k = 0; k < nfits; k++)
+                    line[k] = (pa[k] * x + pb[k]) * x + pc[k];
+            }
+        });
+        return 0;
+    }
+
+    /* p holds the coefficients highest power first */
+    double polyval(const std::vector<double> &p, double x) {
+        double output = 0;
+        for (int i = 0; i < (int)p.size(); i++)
+            output = output * x + p[i];
         return output;
     }
 
-    std::vector<double> polyval(std::vector<double> p, std::vector<double> x) {
+    std::vector<double> polyval(const std::vector<double> &p, const std::vector<double> &x) {
         long polyCnt = x.size();
         std::vector<double> output = std::vector<double>(polyCnt, 1);
         for (int i = 0; i < polyCnt; i++) {
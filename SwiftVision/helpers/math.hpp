@@ -2,6 +2,7 @@
 #define dewarp_math_hpp
 
 #include "DataTypes.h"
+#include "Arena.hpp"
 
 namespace math {
     int gaussjordan(double **a,
@@ -19,6 +20,35 @@ namespace math {
                            double *pb,
                            double *pc,
                            double *pmederr);
+    /* Robust quadratic fits to the left and right margin end points,
+     * in the transposed form used by getHorizontalDisparity (x is the
+     * image row, y the column).  Each margin is fitted by at most
+     * maxiters rounds of iteratively reweighted least squares with
+     * Tukey's biweight, starting from the median column, so headings,
+     * page numbers and short lines don't bend the margin.  pcl and pcr
+     * receive 3 coefficients each, highest power first.  The optional
+     * pptal2 and pptar2 are the end points kept as inliers, and pniters
+     * the most rounds either margin took. */
+    int dewarpRobustMarginLSF(vectorPointD *ptal,
+                              vectorPointD *ptar,
+                              int maxiters,
+                              Arena *arena,
+                              double *pcl,
+                              double *pcr,
+                              vectorPointD **pptal2,
+                              vectorPointD **pptar2,
+                              int *pniters);
+    /* The same, on nl and nr end points in arena or caller memory;
+     * nothing is allocated from the heap. */
+    int dewarpRobustMarginLSF(const DPoint *ptal,
+                              int nl,
+                              const DPoint *ptar,
+                              int nr,
+                              int maxiters,
+                              Arena *arena,
+                              double *pcl,
+                              double *pcr,
+                              int *pniters);
     int applyQuadraticFit(double a,
                           double b,
                           double c,
@@ -33,6 +63,67 @@ namespace math {
                        double b,
                        double x,
                        double *py);
+
+    /* Batched fits.  The point sets are given in SoA form: fit k uses
+     * the points (xs[i], ys[i]) for offsets[k] <= i < offsets[k + 1].
+     * The moments of every set are gathered first and the normal
+     * equations are then solved in closed form, all fits at once.
+     * A set with too few distinct x values gets zero coefficients.
+     * If perr is given it receives the rms residual of each fit, or
+     * -1.0 where the fit failed. */
+    int getQuadraticLSFBatch(const double *xs,
+                             const double *ys,
+                             const int *offsets,
+                             int nfits,
+                             Arena *arena,
+                             double *pa,
+                             double *pb,
+                             double *pc,
+                             double *perr);
+    int getLinearLSFBatch(const double *xs,
+                          const double *ys,
+                          const int *offsets,
+                          int nfits,
+                          double *pa,
+                          double *pb,
+                          double *perr);
+
+    /* Quadratic fits of every column of the row-major n x nfits table
+     * ys (rows stride apart) against the same abscissae xs.  Slices of
+     * the columns are fitted on separate threads. */
+    int getQuadraticLSFColumns(const double *xs,
+                               int n,
+                               const double *ys,
+                               int stride,
+                               int nfits,
+                               double *pa,
+                               double *pb,
+                               double *pc,
+                               double *perr);
+
+    /* The nfits quadratics pa x^2 + pb x + pc at x = x0 + i * dx,
+     * i = 0 ... n - 1.  Rows writes fit k along row k of pd; Columns
+     * writes it down column k, so row i holds every fit at the same x.
+     * Rows are stride elements apart, and either way pd is filled by
+     * contiguous row sweeps spread over threads. */
+    int evaluateQuadraticRows(const double *pa,
+                              const double *pb,
+                              const double *pc,
+                              int nfits,
+                              double x0,
+                              double dx,
+                              int n,
+                              double *pd,
+                              int stride);
+    int evaluateQuadraticColumns(const double *pa,
+                                 const double *pb,
+                                 const double *pc,
+                                 int nfits,
+                                 double x0,
+                                 double dx,
+                                 int n,
+                                 double *pd,
+                                 int stride);
 }
 
 #endif /* dewarp_math_hpp */
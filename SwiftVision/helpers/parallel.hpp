@@ -0,0 +1,201 @@
+#ifndef parallel_hpp
+#define parallel_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*----------------------------------------------------------------------------*
+ *                           Parallel loops                                   *
+ *                                                                            *
+ *  forRange(n, grain, body) splits [0, n) into one contiguous chunk per      *
+ *  thread and calls body(begin, end) for each.  The chunks run on a pool     *
+ *  of worker threads started once, on first use, with the calling thread     *
+ *  taking chunks too; a loop costs a wake-up, not a thread start.  Chunks    *
+ *  are never smaller than grain, so small ranges run inline.  A loop         *
+ *  started while the pool is busy (nested in a body, or from a second        *
+ *  thread) runs inline as well.  body must be safe to call concurrently on   *
+ *  disjoint ranges.                                                          *
+ *----------------------------------------------------------------------------*/
+
+namespace parallel {
+    /* Upper bound on threadCount(); 0 is no bound */
+    inline std::atomic<int> &threadLimit() {
+        static std::atomic<int> limit(0);
+        return limit;
+    }
+
+    /* Caps the threads every loop may use, e.g. 1 to run everything
+     * inline when comparing against a single core; 0 lifts the cap. */
+    inline void setThreadLimit(int n) {
+        threadLimit() = (n < 0) ? 0 : n;
+    }
+
+    /* The hardware concurrency, between 1 and 8 */
+    inline int hardwareThreads() {
+        unsigned int hw = std::thread::hardware_concurrency();
+        return (hw < 1) ? 1 : (hw > 8) ? 8 : (int)hw;
+    }
+
+    /* Threads to use: hardwareThreads(), and no more than the limit */
+    inline int threadCount() {
+        int n = hardwareThreads();
+        int limit = threadLimit();
+        return (limit > 0 && limit < n) ? limit : n;
+    }
+
+    /* The number of chunks forRange(n, grain, ...) splits [0, n) into;
+     * chunk k starts at k * *pchunk.  Callers use it to set aside
+     * per-chunk scratch before the loop. */
+    inline int chunkCount(int n,
+                          int grain,
+                          int *pchunk) {
+        int nthreads;
+
+        if (n <= 0) {
+            *pchunk = 1;
+            return 0;
+        }
+        if (grain < 1)
+            grain = 1;
+        nthreads = threadCount();
+        if (nthreads > (n + grain - 1) / grain)
+            nthreads = (n + grain - 1) / grain;
+        if (nthreads < 1)
+            nthreads = 1;
+        *pchunk = (n + nthreads - 1) / nthreads;
+        return nthreads;
+    }
+
+    /* hardwareThreads() - 1 workers, kept for the life of the process */
+    class Pool {
+    public:
+        typedef void (*Task)(void *context, int index);
+
+        static Pool &shared() {
+            static Pool pool(hardwareThreads() - 1);
+            return pool;
+        }
+
+        ~Pool() {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                stop = true;
+            }
+            wake.notify_all();
+            for (int i = 0; i < (int)workers.size(); i++)
+                workers[i].join();
+        }
+
+        /* Calls task(context, i) for every i in [0, ntasks), spread over
+         * the workers and the calling thread, and returns when all are
+         * done; inline if the pool is already running a loop */
+        void run(int ntasks,
+                 Task task,
+                 void *context) {
+            int i;
+
+            if (workers.empty() || ntasks < 2 || running.exchange(true)) {
+                for (i = 0; i < ntasks; i++)
+                    task(context, i);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                this->task = task;
+                this->context = context;
+                this->ntasks = ntasks;
+                next = 0;
+                active = (int)workers.size();
+                generation++;
+            }
+            wake.notify_all();
+            while ((i = next++) < ntasks)
+                task(context, i);
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                done.wait(guard, [this]() { return active == 0; });
+            }
+            running = false;
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex               mutex;
+        std::condition_variable  wake, done;
+        std::atomic<bool>        running;       /*!< a loop owns the pool            */
+        std::atomic<int>         next;          /*!< next task to hand out           */
+        Task                     task;
+        void                    *context;
+        int                      ntasks;
+        int                      active;        /*!< workers still in this loop      */
+        unsigned int             generation;    /*!< loops started                   */
+        bool                     stop;
+
+        explicit Pool(int nworkers)
+            : running(false), next(0), task(NULL), context(NULL),
+              ntasks(0), active(0), generation(0), stop(false) {
+            for (int i = 0; i < nworkers; i++)
+                workers.push_back(std::thread([this]() { work(); }));
+        }
+        Pool(const Pool &);
+        Pool &operator=(const Pool &);
+
+        void work() {
+            unsigned int seen = 0;
+            int i;
+
+            std::unique_lock<std::mutex> guard(mutex);
+            for (;;) {
+                wake.wait(guard, [this, &seen]() { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+                guard.unlock();
+                while ((i = next++) < ntasks)
+                    task(context, i);
+                guard.lock();
+                if (--active == 0)
+                    done.notify_one();
+            }
+        }
+    };
+
+    /* Chunk t of a forRange loop, as a pool task */
+    template <typename Body>
+    struct RangeChunks {
+        const Body *body;
+        int         n, chunk;
+
+        static void run(void *context,
+                        int t) {
+            const RangeChunks *chunks = (const RangeChunks *)context;
+            int begin = t * chunks->chunk;
+            int end = (begin + chunks->chunk < chunks->n) ? begin + chunks->chunk : chunks->n;
+            if (begin < end)
+                (*chunks->body)(begin, end);
+        }
+    };
+
+    template <typename Body>
+    void forRange(int n,
+                  int grain,
+                  const Body &body) {
+        int nthreads, chunk;
+
+        nthreads = chunkCount(n, grain, &chunk);
+        if (nthreads < 1)
+            return;
+        if (nthreads == 1) {
+            body(0, n);
+            return;
+        }
+
+        RangeChunks<Body> chunks = { &body, n, chunk };
+        Pool::shared().run(nthreads, RangeChunks<Body>::run, &chunks);
+    }
+}
+
+#endif /* parallel_hpp */
@@ -0,0 +1,209 @@
+#ifndef polyfit_hpp
+#define polyfit_hpp
+
+#include <math.h>
+#include "DataTypes.h"
+
+/*----------------------------------------------------------------------------*
+ *                     Fixed degree polynomial fits                           *
+ *                                                                            *
+ *  PolyFit<Degree, Scalar> is the least squares fit                          *
+ *      y = c[0] x^Degree + ... + c[Degree - 1] x + c[Degree]                 *
+ *  The degree is a template parameter, so the power sums, the Cholesky       *
+ *  solution of the normal equations and the Horner evaluation all have       *
+ *  compile time trip counts and unroll completely.  The fit is done in       *
+ *      u = (x - center) / scale                                              *
+ *  with the mean and the rms spread of the x values, which keeps the         *
+ *  normal matrix well conditioned for pixel coordinates (x^6 is ~1e19 at     *
+ *  1440 px), and the polynomial is kept and evaluated in u.                  *
+ *                                                                            *
+ *      PolyFit<3> line;                                                      *
+ *      if (!line.fit(pta))                                                   *
+ *          line.evaluateGrid(0.0, sampling, nx, ys);                         *
+ *----------------------------------------------------------------------------*/
+
+template <int Degree, typename Scalar = double>
+class PolyFit {
+public:
+    enum { NCOEFFS = Degree + 1 };
+
+    PolyFit() : center(0), invscale(1) {
+        for (int k = 0; k < NCOEFFS; k++)
+            cu[k] = 0;
+    }
+
+    /* the polynomial with the given coefficients, highest power first */
+    static PolyFit fromCoefficients(const Scalar *coeffs) {
+        PolyFit poly;
+        for (int k = 0; k < NCOEFFS; k++)
+            poly.cu[k] = coeffs[Degree - k];
+        return poly;
+    }
+
+    /* Fits n points; returns 1, leaving a zero polynomial, if there
+     * are fewer than Degree + 1 distinct x values. */
+    int fit(const Scalar *xs,
+            const Scalar *ys,
+            int n) {
+        return fitPoints(xs, ys, n, 1);
+    }
+
+    int fit(const vectorPointD *pta) {
+        if (!pta || pta->empty())
+            return fitPoints((const double *)NULL, (const double *)NULL, 0, 2);
+        return fitPoints(&(*pta)[0].x, &(*pta)[0].y, (int)pta->size(), 2);
+    }
+
+    Scalar operator()(Scalar x) const {
+        return horner((x - center) * invscale);
+    }
+
+    /* Writes p(x0 + i * dx), i = 0 ... n - 1, to py[i * stride] */
+    int evaluateGrid(Scalar x0,
+                     Scalar dx,
+                     int n,
+                     Scalar *py,
+                     int stride = 1) const {
+        int i;
+        Scalar u0, du;
+
+        if (!py || n < 0 || stride < 1)
+            return 1;
+
+        u0 = (x0 - center) * invscale;
+        du = dx * invscale;
+        if (stride == 1) {
+            for (i = 0; i < n; i++)
+                py[i] = horner(u0 + (Scalar)i * du);
+        } else {
+            for (i = 0; i < n; i++)
+                py[(size_t)i * stride] = horner(u0 + (Scalar)i * du);
+        }
+        return 0;
+    }
+
+    /* Coefficients in x, highest power first */
+    int getCoefficients(Scalar *pcoeffs) const {
+        int j, k;
+        Scalar alpha, beta, raw[NCOEFFS];
+
+        if (!pcoeffs)
+            return 1;
+
+        /* Horner's rule on polynomials: raw = raw * (alpha x + beta) + cu[k] */
+        alpha = invscale;
+        beta = -center * invscale;
+        for (j = 0; j < NCOEFFS; j++)
+            raw[j] = 0;
+        raw[0] = cu[Degree];
+        for (k = Degree - 1; k >= 0; k--) {
+            for (j = Degree; j > 0; j--)
+                raw[j] = raw[j] * beta + raw[j - 1] * alpha;
+            raw[0] = raw[0] * beta + cu[k];
+        }
+        for (j = 0; j < NCOEFFS; j++)
+            pcoeffs[j] = raw[Degree - j];
+        return 0;
+    }
+
+private:
+    Scalar center;          /*!< mean of the fitted x values                */
+    Scalar invscale;        /*!< 1 / rms spread of the fitted x values      */
+    Scalar cu[NCOEFFS];     /*!< coefficients in u, lowest power first      */
+
+    Scalar horner(Scalar u) const {
+        Scalar y = cu[Degree];
+        for (int k = Degree - 1; k >= 0; k--)
+            y = y * u + cu[k];
+        return y;
+    }
+
+    template <typename T>
+    int fitPoints(const T *xs,
+                  const T *ys,
+                  int n,
+                  int stride) {
+        int i, j, k;
+        Scalar mean, spread, u, y, p, sum;
+        Scalar S[2 * Degree + 1], A[NCOEFFS][NCOEFFS], b[NCOEFFS];
+
+        center = 0;
+        invscale = 1;
+        for (k = 0; k < NCOEFFS; k++)
+            cu[k] = 0;
+        if (!xs || !ys || n < NCOEFFS)
+            return 1;
+
+        mean = 0;
+        for (i = 0; i < n; i++)
+            mean += (Scalar)xs[(size_t)i * stride];
+        mean /= n;
+        spread = 0;
+        for (i = 0; i < n; i++) {
+            u = (Scalar)xs[(size_t)i * stride] - mean;
+            spread += u * u;
+        }
+        spread = sqrt(spread / n);
+        if (!(spread > 0))
+            return 1;
+
+        /* Power sums S[k] = sum(u^k) and moments b[k] = sum(u^k y) */
+        for (k = 0; k <= 2 * Degree; k++)
+            S[k] = 0;
+        for (k = 0; k < NCOEFFS; k++)
+            b[k] = 0;
+        for (i = 0; i < n; i++) {
+            u = ((Scalar)xs[(size_t)i * stride] - mean) / spread;
+            y = (Scalar)ys[(size_t)i * stride];
+            p = 1;
+            for (k = 0; k <= 2 * Degree; k++) {
+                S[k] += p;
+                if (k < NCOEFFS)
+                    b[k] += p * y;
+                p *= u;
+            }
+        }
+
+        /* Cholesky factorization of the normal matrix A[j][k] = S[j + k],
+         * in place in the lower triangle */
+        for (j = 0; j < NCOEFFS; j++)
+            for (k = 0; k < NCOEFFS; k++)
+                A[j][k] = S[j + k];
+        for (j = 0; j < NCOEFFS; j++) {
+            sum = A[j][j];
+            for (k = 0; k < j; k++)
+                sum -= A[j][k] * A[j][k];
+            if (!(sum > (Scalar)1.0e-10 * S[2 * j]))
+                return 1;  /* too few distinct x values */
+            A[j][j] = sqrt(sum);
+            for (i = j + 1; i < NCOEFFS; i++) {
+                sum = A[i][j];
+                for (k = 0; k < j; k++)
+                    sum -= A[i][k] * A[j][k];
+                A[i][j] = sum / A[j][j];
+            }
+        }
+
+        /* Forward, then back substitution */
+        for (j = 0; j < NCOEFFS; j++) {
+            sum = b[j];
+            for (k = 0; k < j; k++)
+                sum -= A[j][k] * b[k];
+            b[j] = sum / A[j][j];
+        }
+        for (j = Degree; j >= 0; j--) {
+            sum = b[j];
+            for (k = j + 1; k < NCOEFFS; k++)
+                sum -= A[k][j] * b[k];
+            b[j] = sum / A[j][j];
+        }
+
+        center = mean;
+        invscale = 1 / spread;
+        for (k = 0; k < NCOEFFS; k++)
+            cu[k] = b[k];
+        return 0;
+    }
+};
+
+#endif /* polyfit_hpp */
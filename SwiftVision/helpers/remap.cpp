@@ -0,0 +1,479 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "remap.hpp"
+#include "parallel.hpp"
+
+namespace remap {
+    /* Interpolates the grid rows around output row i into rowd, giving
+     * the disparity of row i at every grid column */
+    static void interpolateGridRow(const fieldD *grid,
+                                   double ysampling,
+                                   int i,
+                                   double *rowd) {
+        int j, gi, nx;
+        double fract;
+        const double *line0, *line1;
+
+        nx = grid->width();
+        gi = std::min((int)(i / ysampling), grid->height() - 1);
+        fract = (i - gi * ysampling) / ysampling;
+        line0 = grid->row(gi);
+        if (gi + 1 >= grid->height() || fract <= 0.0) {
+            memcpy(rowd, line0, nx * sizeof(double));
+            return;
+        }
+        line1 = grid->row(gi + 1);
+        for (j = 0; j < nx; j++)
+            rowd[j] = line0[j] * (1.0 - fract) + line1[j] * fract;
+    }
+
+    /* Grid columns on either side of each image column, and the weight
+     * of the right one.  The same for every row, so computed once. */
+    static void gridColumns(int w,
+                            int nx,
+                            double xsampling,
+                            int *gcol0,
+                            int *gcol1,
+                            double *fcol) {
+        int j, gj;
+
+        for (j = 0; j < w; j++) {
+            gj = std::min((int)(j / xsampling), nx - 1);
+            gcol0[j] = gj;
+            gcol1[j] = std::min(gj + 1, nx - 1);
+            fcol[j] = (j - gj * xsampling) / xsampling;
+        }
+    }
+
+    /* Expands one row of grid samples to the disparity of every pixel */
+    static void expandGridRow(const double *rowd,
+                              int w,
+                              const int *gcol0,
+                              const int *gcol1,
+                              const double *fcol,
+                              double *disp) {
+        for (int j = 0; j < w; j++)
+            disp[j] = rowd[gcol0[j]] * (1.0 - fcol[j]) + rowd[gcol1[j]] * fcol[j];
+    }
+
+    /* Source coordinates of every pixel of output row i.  For nearest
+     * sampling isrc and jsrc are the rounded, clamped source row and
+     * column; for bilinear they are the top left of the 2 x 2
+     * neighbourhood and wy, wx the 8 bit weights of the row below and the
+     * column to the right.  The vertical disparity is looked up at the
+     * source column, as if the horizontal warp ran on the output of the
+     * vertical one.  Without hdisp, jsrc and wx are left untouched. */
+    static void sourceCoords(int w,
+                             int h,
+                             int i,
+                             const double *vdisp,
+                             const double *hdisp,
+                             int interpolation,
+                             int *isrc,
+                             int *jsrc,
+                             int *wy,
+                             int *wx) {
+        int j, r, c;
+        double x, y;
+
+        if (interpolation == REMAP_NEAREST) {
+            if (!hdisp) {
+                for (j = 0; j < w; j++) {
+                    r = (int)(i - vdisp[j] + 0.5);
+                    isrc[j] = r < 0 ? 0 : (r > h - 1 ? h - 1 : r);
+                }
+                return;
+            }
+            for (j = 0; j < w; j++) {
+                c = (int)(j - hdisp[j] + 0.5);
+                c = c < 0 ? 0 : (c > w - 1 ? w - 1 : c);
+                r = (int)(i - vdisp[c] + 0.5);
+                jsrc[j] = c;
+                isrc[j] = r < 0 ? 0 : (r > h - 1 ? h - 1 : r);
+            }
+            return;
+        }
+
+        for (j = 0; j < w; j++) {
+            c = j;
+            if (hdisp) {
+                x = j - hdisp[j];
+                x = x < 0.0 ? 0.0 : (x > w - 1 ? (double)(w - 1) : x);
+                c = (int)x;
+                jsrc[j] = c;
+                wx[j] = (int)((x - c) * 256.0 + 0.5);
+                c = (int)(x + 0.5);
+            }
+            y = i - vdisp[c];
+            y = y < 0.0 ? 0.0 : (y > h - 1 ? (double)(h - 1) : y);
+            r = (int)y;
+            isrc[j] = r;
+            wy[j] = (int)((y - r) * 256.0 + 0.5);
+        }
+    }
+
+    /* (1 - t) p0 + t p1 for each byte of two packed RGBA pixels, t in
+     * 256ths; two channels per 32 bit lane, bytes 0 and 2, then 1 and 3 */
+    static inline uint32_t lerpPixel(uint32_t p0,
+                                     uint32_t p1,
+                                     int t) {
+        uint32_t lo, hi;
+
+        lo = ((p0 & 0x00ff00ff) * (256 - t) + (p1 & 0x00ff00ff) * t + 0x00800080) >> 8;
+        hi = ((p0 >> 8) & 0x00ff00ff) * (256 - t) + ((p1 >> 8) & 0x00ff00ff) * t + 0x00800080;
+        return (lo & 0x00ff00ff) | (hi & 0xff00ff00);
+    }
+
+    static inline int lerpByte(int a,
+                               int b,
+                               int t) {
+        return (a * (256 - t) + b * t + 128) >> 8;
+    }
+
+    /* Channels is a constant in the specialized callers (0 for any other
+     * count), so the per pixel copy unrolls.  jsrc is NULL when there is
+     * no horizontal disparity. */
+    template <int Channels>
+    static void gatherNearest(const uint8_t *src,
+                              int w,
+                              int channels,
+                              int srcstride,
+                              const int *isrc,
+                              const int *jsrc,
+                              uint8_t *lined) {
+        int j, k, nc;
+        const uint8_t *lines;
+
+        nc = Channels ? Channels : channels;
+        for (j = 0; j < w; j++) {
+            lines = src + (size_t)isrc[j] * srcstride + (size_t)(jsrc ? jsrc[j] : j) * nc;
+            if (Channels == 4) {
+                memcpy(lined + (size_t)j * 4, lines, 4);
+            } else {
+                for (k = 0; k < nc; k++)
+                    lined[(size_t)j * nc + k] = lines[k];
+            }
+        }
+    }
+
+    template <int Channels>
+    static void gatherBilinear(const uint8_t *src,
+                               int w,
+                               int h,
+                               int channels,
+                               int srcstride,
+                               const int *isrc,
+                               const int *jsrc,
+                               const int *wy,
+                               const int *wx,
+                               uint8_t *lined) {
+        int j, k, nc, c, dx;
+        uint32_t p00, p01, p10, p11, top, bottom;
+        const uint8_t *line0, *line1;
+
+        nc = Channels ? Channels : channels;
+        for (j = 0; j < w; j++) {
+            c = jsrc ? jsrc[j] : j;
+            line0 = src + (size_t)isrc[j] * srcstride + (size_t)c * nc;
+            line1 = (isrc[j] + 1 < h) ? line0 + srcstride : line0;
+            if (!jsrc) {
+                if (Channels == 4) {
+                    memcpy(&p00, line0, 4);
+                    memcpy(&p10, line1, 4);
+                    top = lerpPixel(p00, p10, wy[j]);
+                    memcpy(lined + (size_t)j * 4, &top, 4);
+                } else {
+                    for (k = 0; k < nc; k++)
+                        lined[(size_t)j * nc + k] = (uint8_t)lerpByte(line0[k], line1[k], wy[j]);
+                }
+                continue;
+            }
+
+            /* blend along x on both rows, then along y */
+            dx = (c + 1 < w) ? nc : 0;
+            if (Channels == 4) {
+                memcpy(&p00, line0, 4);
+                memcpy(&p01, line0 + dx, 4);
+                memcpy(&p10, line1, 4);
+                memcpy(&p11, line1 + dx, 4);
+                top = lerpPixel(p00, p01, wx[j]);
+                bottom = lerpPixel(p10, p11, wx[j]);
+                top = lerpPixel(top, bottom, wy[j]);
+                memcpy(lined + (size_t)j * 4, &top, 4);
+            } else {
+                for (k = 0; k < nc; k++)
+                    lined[(size_t)j * nc + k] = (uint8_t)lerpByte(lerpByte(line0[k], line0[dx + k], wx[j]),
+                                                                  lerpByte(line1[k], line1[dx + k], wx[j]),
+                                                                  wy[j]);
+            }
+        }
+    }
+
+    template <int Channels>
+    static void gatherRow(const uint8_t *src,
+                          int w,
+                          int h,
+                          int channels,
+                          int srcstride,
+                          int interpolation,
+                          const int *isrc,
+                          const int *jsrc,
+                          const int *wy,
+                          const int *wx,
+                          uint8_t *lined) {
+        if (interpolation == REMAP_BILINEAR)
+            gatherBilinear<Channels>(src, w, h, channels, srcstride, isrc, jsrc, wy, wx, lined);
+        else
+            gatherNearest<Channels>(src, w, channels, srcstride, isrc, jsrc, lined);
+    }
+
+    static int checkGrid(const fieldD *grid,
+                         int w,
+                         int h,
+                         double xsampling,
+                         double ysampling) {
+        if (!grid || grid->width() < 1 || grid->height() < 1)
+            return 1;
+        if (grid->width() * xsampling < w - 1 || grid->height() * ysampling < h - 1)
+            return 1;
+        return 0;
+    }
+
+    int pixelChannels(int format) {
+        switch (format) {
+            case PIXEL_GRAY8:
+                return 1;
+            case PIXEL_RGB8:
+            case PIXEL_BGR8:
+                return 3;
+            case PIXEL_RGBA8:
+            case PIXEL_BGRA8:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    /* Converts a row of w pixels between two different formats.  Gray
+     * is the Rec. 601 luma in 8 bit fixed point; a missing alpha is
+     * opaque. */
+    static void convertRow(const uint8_t *s,
+                           int sformat,
+                           uint8_t *d,
+                           int dformat,
+                           int w) {
+        int j, r, g, b, a, ns, nd;
+
+        ns = pixelChannels(sformat);
+        nd = pixelChannels(dformat);
+        for (j = 0; j < w; j++, s += ns, d += nd) {
+            a = 255;
+            switch (sformat) {
+                case PIXEL_GRAY8:
+                    r = g = b = s[0];
+                    break;
+                case PIXEL_BGR8:
+                case PIXEL_BGRA8:
+                    b = s[0]; g = s[1]; r = s[2];
+                    break;
+                default:
+                    r = s[0]; g = s[1]; b = s[2];
+                    break;
+            }
+            if (ns == 4)
+                a = s[3];
+            switch (dformat) {
+                case PIXEL_GRAY8:
+                    d[0] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+                    break;
+                case PIXEL_BGR8:
+                case PIXEL_BGRA8:
+                    d[0] = (uint8_t)b; d[1] = (uint8_t)g; d[2] = (uint8_t)r;
+                    break;
+                default:
+                    d[0] = (uint8_t)r; d[1] = (uint8_t)g; d[2] = (uint8_t)b;
+                    break;
+            }
+            if (nd == 4)
+                d[3] = (uint8_t)a;
+        }
+    }
+
+    /* The warp behind every entry point.  With dformat equal to sformat
+     * (or both -1, for raw channel counts) rows are gathered straight
+     * into dst; otherwise each row is gathered into a scratch row in the
+     * source format and converted into dst from there, while it is still
+     * in cache. */
+    static int remapImage(const uint8_t *src,
+                          int w,
+                          int h,
+                          int channels,
+                          int srcstride,
+                          int sformat,
+                          const fieldD *vgrid,
+                          const fieldD *hgrid,
+                          double xsampling,
+                          double ysampling,
+                          Arena *arena,
+                          uint8_t *dst,
+                          int dststride,
+                          int dformat,
+                          int interpolation) {
+        int nx, nchunks, chunk;
+        int *gcol0, *gcol1, *ibufs;
+        double *fcol, *rowbufs, *vbufs, *hbufs;
+        uint8_t *pixbufs;
+        bool convert;
+
+        if (!src || !dst || !vgrid || !arena)
+            return 1;
+        if (w <= 0 || h <= 0 || channels <= 0 || !(xsampling > 0.0) || !(ysampling > 0.0))
+            return 1;
+        if (interpolation != REMAP_NEAREST && interpolation != REMAP_BILINEAR)
+            return 1;
+        if (checkGrid(vgrid, w, h, xsampling, ysampling))
+            return 1;
+        if (hgrid && (hgrid->width() != vgrid->width() || hgrid->height() != vgrid->height()))
+            return 1;
+
+        ArenaScope scope(arena);
+        nx = vgrid->width();
+        gcol0 = arena->alloc<int>(w);
+        gcol1 = arena->alloc<int>(w);
+        fcol = arena->alloc<double>(w);
+        if (!gcol0 || !gcol1 || !fcol)
+            return 1;
+        gridColumns(w, nx, xsampling, gcol0, gcol1, fcol);
+
+        /* Each chunk of rows gets its own row buffers, set aside here
+         * since the arena is not shared across threads. */
+        convert = sformat != dformat;
+        nchunks = parallel::chunkCount(h, 32, &chunk);
+        rowbufs = arena->alloc<double>((size_t)nchunks * nx);
+        vbufs = arena->alloc<double>((size_t)nchunks * w);
+        hbufs = arena->alloc<double>((size_t)nchunks * w);
+        ibufs = arena->alloc<int>((size_t)nchunks * w * 4);
+        pixbufs = convert ? arena->alloc<uint8_t>((size_t)nchunks * w * channels) : NULL;
+        if (!rowbufs || !vbufs || !hbufs || !ibufs || (convert && !pixbufs))
+            return 1;
+        parallel::forRange(h, 32, [&](int begin, int end) {
+            int c = begin / chunk;
+            double *rowd = rowbufs + (size_t)c * nx;
+            double *vdisp = vbufs + (size_t)c * w;
+            double *hdisp = hbufs + (size_t)c * w;
+            int *isrc = ibufs + (size_t)c * w * 4;
+            int *jsrc = isrc + w, *wy = isrc + 2 * w, *wx = isrc + 3 * w;
+            const int *pjsrc = hgrid ? jsrc : NULL;
+            uint8_t *pixrow = convert ? pixbufs + (size_t)c * w * channels : NULL;
+            for (int i = begin; i < end; i++) {
+                uint8_t *lined = convert ? pixrow : dst + (size_t)i * dststride;
+                interpolateGridRow(vgrid, ysampling, i, rowd);
+                expandGridRow(rowd, w, gcol0, gcol1, fcol, vdisp);
+                if (hgrid) {
+                    interpolateGridRow(hgrid, ysampling, i, rowd);
+                    expandGridRow(rowd, w, gcol0, gcol1, fcol, hdisp);
+                }
+                sourceCoords(w, h, i, vdisp, hgrid ? hdisp : NULL, interpolation,
+                             isrc, jsrc, wy, wx);
+                switch (channels) {
+                    case 1:
+                        gatherRow<1>(src, w, h, channels, srcstride, interpolation,
+                                     isrc, pjsrc, wy, wx, lined);
+                        break;
+                    case 3:
+                        gatherRow<3>(src, w, h, channels, srcstride, interpolation,
+                                     isrc, pjsrc, wy, wx, lined);
+                        break;
+                    case 4:
+                        gatherRow<4>(src, w, h, channels, srcstride, interpolation,
+                                     isrc, pjsrc, wy, wx, lined);
+                        break;
+                    default:
+                        gatherRow<0>(src, w, h, channels, srcstride, interpolation,
+                                     isrc, pjsrc, wy, wx, lined);
+                        break;
+                }
+                if (convert)
+                    convertRow(pixrow, sformat, dst + (size_t)i * dststride, dformat, w);
+            }
+        });
+        return 0;
+    }
+
+    int applyDisparity(const uint8_t *src,
+                       int w,
+                       int h,
+                       int channels,
+                       int srcstride,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       double xsampling,
+                       double ysampling,
+                       Arena *arena,
+                       uint8_t *dst,
+                       int dststride,
+                       int interpolation) {
+        return remapImage(src, w, h, channels, srcstride, -1, vgrid, hgrid, xsampling, ysampling,
+                          arena, dst, dststride, -1, interpolation);
+    }
+
+    int applyDisparity(const ConstImageView *src,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       double xsampling,
+                       double ysampling,
+                       Arena *arena,
+                       const ImageView *dst,
+                       int interpolation) {
+        int nsrc, ndst;
+
+        if (!src || !dst)
+            return 1;
+        nsrc = pixelChannels(src->format);
+        ndst = pixelChannels(dst->format);
+        if (nsrc == 0 || ndst == 0)
+            return 1;
+        if (src->width != dst->width || src->height != dst->height)
+            return 1;
+        if (src->stride < src->width * nsrc || dst->stride < dst->width * ndst)
+            return 1;
+        return remapImage(src->data, src->width, src->height, nsrc, src->stride, src->format,
+                          vgrid, hgrid, xsampling, ysampling, arena,
+                          dst->data, dst->stride, dst->format, interpolation);
+    }
+
+    int applyDisparity(const uint8_t *src,
+                       int w,
+                       int h,
+                       int channels,
+                       int srcstride,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       int sampling,
+                       Arena *arena,
+                       uint8_t *dst,
+                       int dststride,
+                       int interpolation) {
+        if (sampling <= 0)
+            return 1;
+        return applyDisparity(src, w, h, channels, srcstride, vgrid, hgrid,
+                              (double)sampling, (double)sampling, arena, dst, dststride,
+                              interpolation);
+    }
+
+    int applyVerticalDisparity(const uint8_t *src,
+                               int w,
+                               int h,
+                               int channels,
+                               int srcstride,
+                               const fieldD *grid,
+                               int sampling,
+                               Arena *arena,
+                               uint8_t *dst,
+                               int dststride,
+                               int interpolation) {
+        return applyDisparity(src, w, h, channels, srcstride, grid, NULL, sampling,
+                              arena, dst, dststride, interpolation);
+    }
+}
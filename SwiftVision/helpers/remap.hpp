@@ -0,0 +1,146 @@
+#ifndef remap_hpp
+#define remap_hpp
+
+#include <stdint.h>
+#include "Field2D.hpp"
+#include "Arena.hpp"
+
+/*----------------------------------------------------------------------------*
+ *                          Disparity remapping                               *
+ *                                                                            *
+ *  Warps an interleaved 8 bit image by a disparity sampled on a coarse       *
+ *  grid: grid value (gi, gj) is the disparity at pixel (gi * sampling,       *
+ *  gj * sampling), and values in between are interpolated bilinearly,       *
+ *  exactly as dewarp::scaleByInteger would expand them.  The full           *
+ *  resolution map is never built; each output row interpolates the two      *
+ *  grid rows around it into a buffer of one row of grid samples and then    *
+ *  expands that along x as it goes, so the working set is O(grid).           *
+ *                                                                            *
+ *  For the vertical disparity dv, output pixel (i, j) samples the source    *
+ *  at y = i - dv(i, j).  REMAP_NEAREST reads row                             *
+ *      isrc = (int)(y + 0.5)                                                 *
+ *  clamped to the image, the same rounding DisparityModel always used;      *
+ *  REMAP_BILINEAR blends the two rows around y with 8 bit weights.           *
+ *                                                                            *
+ *  applyDisparity also takes the horizontal disparity dh, sampled on a       *
+ *  grid of the same spacing, and resamples each output pixel once from       *
+ *      x = j - dh(i, j),  y = i - dv(i, round(x))                            *
+ *  which is what running the vertical warp and then the horizontal warp      *
+ *  on its output gives, without the intermediate image: exactly for          *
+ *  REMAP_NEAREST, and within a level or two for REMAP_BILINEAR, which        *
+ *  takes dv at the rounded x for both columns it blends.  With hgrid NULL    *
+ *  it is applyVerticalDisparity.  The horizontal term is not free: a         *
+ *  second grid row expansion, a rounding and a dependent lookup per pixel    *
+ *  put h + v at about 1.3 to 1.7 times the vertical only time                *
+ *  (benchmark::verticalRemaps, one core).                                    *
+ *                                                                            *
+ *  The grid spacing may also be given as separate, non-integer x and y      *
+ *  spacings, so a disparity fitted on a downscaled image can be applied     *
+ *  to the full resolution one: scale the grid values by the image scale     *
+ *  (x scale for dh, y scale for dv) and the spacings by the same factors.   *
+ *  Both grids must have the same dimensions.                                 *
+ *                                                                            *
+ *  Whole pixels are moved at once (1, 3 and 4 channels have their own        *
+ *  loops) and output rows are split across threads.  dst is written in       *
+ *  full, so it need not be initialized.  benchmark::verticalRemaps times     *
+ *  the row threads against one thread; its speedups over the old byte loop   *
+ *  are for a single core and were not measured on more.                      *
+ *                                                                            *
+ *  Strides are in bytes.  The grid must cover the image to within one       *
+ *  grid cell:                                                                *
+ *      width() * xsampling >= w - 1, height() * ysampling >= h - 1           *
+ *  and pixels past the last grid column or row take its values (a scaled    *
+ *  grid can fall short of the scaled image by less than one cell).           *
+ *                                                                            *
+ *  The ImageView entry point reads and writes caller-owned buffers of any    *
+ *  stride, e.g. a locked CVPixelBuffer in and an encoder's input buffer     *
+ *  out, so nothing is copied on the way in or out.  The two formats may      *
+ *  differ: each row is gathered in the source format and converted into     *
+ *  dst (swapping to BGR, adding or dropping alpha, or reducing to luma)     *
+ *  while it is still in cache, so there is no full frame conversion pass.   *
+ *----------------------------------------------------------------------------*/
+
+namespace remap {
+    enum {
+        REMAP_NEAREST = 0,
+        REMAP_BILINEAR = 1
+    };
+
+    /* Interleaved 8 bit pixel formats, channels in the order named */
+    enum {
+        PIXEL_GRAY8 = 0,
+        PIXEL_RGB8 = 1,
+        PIXEL_BGR8 = 2,
+        PIXEL_RGBA8 = 3,
+        PIXEL_BGRA8 = 4
+    };
+
+    /* A caller-owned image; stride is in bytes and may include padding */
+    struct ImageView {
+        uint8_t *data;
+        int     width;
+        int     height;
+        int     stride;
+        int     format;         /*!< PIXEL_*                                    */
+    };
+
+    struct ConstImageView {
+        const uint8_t *data;
+        int     width;
+        int     height;
+        int     stride;
+        int     format;         /*!< PIXEL_*                                    */
+    };
+
+    /* Channels of a PIXEL_* format, or 0 if it is unknown */
+    int pixelChannels(int format);
+
+    /* src and dst must have the same size */
+    int applyDisparity(const ConstImageView *src,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       double xsampling,
+                       double ysampling,
+                       Arena *arena,
+                       const ImageView *dst,
+                       int interpolation = REMAP_NEAREST);
+
+    int applyDisparity(const uint8_t *src,
+                       int w,
+                       int h,
+                       int channels,
+                       int srcstride,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       int sampling,
+                       Arena *arena,
+                       uint8_t *dst,
+                       int dststride,
+                       int interpolation = REMAP_NEAREST);
+    int applyDisparity(const uint8_t *src,
+                       int w,
+                       int h,
+                       int channels,
+                       int srcstride,
+                       const fieldD *vgrid,
+                       const fieldD *hgrid,
+                       double xsampling,
+                       double ysampling,
+                       Arena *arena,
+                       uint8_t *dst,
+                       int dststride,
+                       int interpolation = REMAP_NEAREST);
+    int applyVerticalDisparity(const uint8_t *src,
+                               int w,
+                               int h,
+                               int channels,
+                               int srcstride,
+                               const fieldD *grid,
+                               int sampling,
+                               Arena *arena,
+                               uint8_t *dst,
+                               int dststride,
+                               int interpolation = REMAP_NEAREST);
+}
+
+#endif /* remap_hpp */
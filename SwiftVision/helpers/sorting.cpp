@@ -0,0 +1,328 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SORTING_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SORTING_NEON 1
+#endif
+#include "sorting.hpp"
+#include "dewarp.hpp"
+
+namespace sorting {
+    /* 11 bit digits: 6 passes for a double, 3 for a float */
+    static const int kRadixBits = 11;
+    static const int kRadixBins = 1 << kRadixBits;
+    static const int kRadixMask = kRadixBins - 1;
+
+    /* Map the IEEE-754 bit pattern to an unsigned integer with the same
+     * ordering: negative values have all bits flipped, positive values
+     * just get the sign bit set.  Decreasing order inverts the result. */
+    static inline uint64_t radixKey(double val, int sortorder) {
+        suf64 u;
+        u.f = val;
+        uint64_t mask = (u.u >> 63) ? ~(uint64_t)0 : ((uint64_t)1 << 63);
+        uint64_t key = u.u ^ mask;
+        return (sortorder == L_SORT_INCREASING) ? key : ~key;
+    }
+
+    static inline uint64_t radixKey(float val, int sortorder) {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        uint32_t mask = (bits >> 31) ? ~(uint32_t)0 : ((uint32_t)1 << 31);
+        uint32_t key = bits ^ mask;
+        return (sortorder == L_SORT_INCREASING) ? key : (uint32_t)~key;
+    }
+
+    template <typename T, int NPASSES>
+    static int radixSortIndexImpl(const T *keys,
+                                  int n,
+                                  int stride,
+                                  int sortorder,
+                                  uint32_t *index,
+                                  uint32_t *scratch) {
+        int i, pass, shift;
+        uint32_t sum, count;
+        uint32_t *src, *dst, *tmp;
+        uint32_t hist[NPASSES][kRadixBins];
+
+        if (!keys || !index || !scratch)
+            return 1;
+        if (n < 0 || stride < 1)
+            return 1;
+        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
+            return 1;
+
+        /* Histogram every digit in a single pass over the keys */
+        memset(hist, 0, sizeof(hist));
+        for (i = 0; i < n; i++) {
+            uint64_t key = radixKey(keys[(size_t)i * stride], sortorder);
+            for (pass = 0; pass < NPASSES; pass++)
+                hist[pass][(key >> (pass * kRadixBits)) & kRadixMask]++;
+        }
+
+        for (i = 0; i < n; i++)
+            index[i] = i;
+
+        src = index;
+        dst = scratch;
+        for (pass = 0; pass < NPASSES; pass++) {
+            shift = pass * kRadixBits;
+
+            /* A digit shared by every key doesn't reorder anything */
+            if (n > 0 && hist[pass][(radixKey(keys[0], sortorder) >> shift) & kRadixMask] == (uint32_t)n)
+                continue;
+
+            /* Exclusive prefix sum gives the output offset of each bin */
+            for (sum = 0, i = 0; i < kRadixBins; i++) {
+                count = hist[pass][i];
+                hist[pass][i] = sum;
+                sum += count;
+            }
+
+            for (i = 0; i < n; i++) {
+                uint32_t idx = src[i];
+                uint64_t key = radixKey(keys[(size_t)idx * stride], sortorder);
+                dst[hist[pass][(key >> shift) & kRadixMask]++] = idx;
+            }
+            tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+
+        if (src != index)
+            memcpy(index, src, n * sizeof(uint32_t));
+        return 0;
+    }
+
+    int radixSortIndex(const double *keys,
+                       int n,
+                       int stride,
+                       int sortorder,
+                       uint32_t *index,
+                       uint32_t *scratch) {
+        return radixSortIndexImpl<double, (64 + kRadixBits - 1) / kRadixBits>(keys, n, stride, sortorder, index, scratch);
+    }
+
+    int radixSortIndex(const float *keys,
+                       int n,
+                       int stride,
+                       int sortorder,
+                       uint32_t *index,
+                       uint32_t *scratch) {
+        return radixSortIndexImpl<float, (32 + kRadixBits - 1) / kRadixBits>(keys, n, stride, sortorder, index, scratch);
+    }
+
+    static int binOf(double key, int nbins) {
+        int bin = (int)key;
+        return (key >= 0.0 && bin < nbins) ? bin : -1;
+    }
+
+    int binSortIndex(const double *keys,
+                     int n,
+                     int sortorder,
+                     uint32_t *counts,
+                     int nbins,
+                     uint32_t *index) {
+        int i, bin;
+        uint32_t sum, count;
+
+        if (!keys || !counts || !index)
+            return 1;
+        if (n < 0 || nbins <= 0)
+            return 1;
+        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
+            return 1;
+
+        memset(counts, 0, nbins * sizeof(uint32_t));
+        for (i = 0; i < n; i++) {
+            if ((bin = binOf(keys[i], nbins)) < 0)
+                return 1;
+            counts[bin]++;
+        }
+
+        /* Turn the counts into the first output slot of every bin,
+         * walking the bins in the requested order */
+        sum = 0;
+        if (sortorder == L_SORT_INCREASING) {
+            for (i = 0; i < nbins; i++) {
+                count = counts[i];
+                counts[i] = sum;
+                sum += count;
+            }
+        } else {  /* L_SORT_DECREASING */
+            for (i = nbins - 1; i >= 0; i--) {
+                count = counts[i];
+                counts[i] = sum;
+                sum += count;
+            }
+        }
+
+        for (i = 0; i < n; i++)
+            index[counts[(int)keys[i]]++] = i;
+        return 0;
+    }
+
+    int binHistogram(const double *keys,
+                     int n,
+                     uint32_t *cdf,
+                     int nbins) {
+        int i, bin;
+
+        if (!keys || !cdf)
+            return 1;
+        if (n < 0 || nbins <= 0)
+            return 1;
+
+        memset(cdf, 0, nbins * sizeof(uint32_t));
+        for (i = 0; i < n; i++) {
+            if ((bin = binOf(keys[i], nbins)) < 0)
+                return 1;
+            cdf[bin]++;
+        }
+        for (i = 1; i < nbins; i++)
+            cdf[i] += cdf[i - 1];
+        return 0;
+    }
+
+    int histogramRankValue(const uint32_t *cdf,
+                           int nbins,
+                           double fract,
+                           double *pval) {
+        uint32_t n, index;
+
+        if (!pval)
+            return 1;
+        *pval = 0.0;  /* init */
+        if (!cdf || nbins <= 0)
+            return 1;
+        if (fract < 0.0 || fract > 1.0)
+            return 1;
+        if ((n = cdf[nbins - 1]) == 0)
+            return 1;
+
+        /* Same rank as dewarp::getRankValue; the value at sorted
+         * position 'index' is the first bin whose cdf exceeds it */
+        index = (uint32_t)(fract * (double)(n - 1) + 0.5);
+        *pval = (double)(std::upper_bound(cdf, cdf + nbins, index) - cdf);
+        return 0;
+    }
+
+    /* Compare-exchange a[i] with b[i] for i < len; afterwards
+     * a[i] <= b[i].  len is a power of two. */
+    static inline void compareBlock(double *a,
+                                    double *b,
+                                    int len) {
+        int i = 0;
+#if defined(SORTING_SSE2)
+        for (; i + 2 <= len; i += 2) {
+            __m128d va = _mm_loadu_pd(a + i);
+            __m128d vb = _mm_loadu_pd(b + i);
+            _mm_storeu_pd(a + i, _mm_min_pd(va, vb));
+            _mm_storeu_pd(b + i, _mm_max_pd(va, vb));
+        }
+#elif defined(SORTING_NEON)
+        for (; i + 2 <= len; i += 2) {
+            float64x2_t va = vld1q_f64(a + i);
+            float64x2_t vb = vld1q_f64(b + i);
+            vst1q_f64(a + i, vminq_f64(va, vb));
+            vst1q_f64(b + i, vmaxq_f64(va, vb));
+        }
+#endif
+        for (; i < len; i++) {
+            double va = a[i], vb = b[i];
+            a[i] = std::min(va, vb);
+            b[i] = std::max(va, vb);
+        }
+    }
+
+    /* Compare-exchange a[i] with b[len - 1 - i]; this merges an
+     * ascending run with a mirrored one (the bitonic "flip") */
+    static inline void compareFlip(double *a,
+                                   double *b,
+                                   int len) {
+        int i = 0;
+#if defined(SORTING_SSE2)
+        for (; i + 2 <= len; i += 2) {
+            __m128d va = _mm_loadu_pd(a + i);
+            __m128d vb = _mm_loadu_pd(b + len - 2 - i);
+            vb = _mm_shuffle_pd(vb, vb, 1);
+            __m128d vmax = _mm_max_pd(va, vb);
+            _mm_storeu_pd(a + i, _mm_min_pd(va, vb));
+            _mm_storeu_pd(b + len - 2 - i, _mm_shuffle_pd(vmax, vmax, 1));
+        }
+#elif defined(SORTING_NEON)
+        for (; i + 2 <= len; i += 2) {
+            float64x2_t va = vld1q_f64(a + i);
+            float64x2_t vb = vld1q_f64(b + len - 2 - i);
+            vb = vextq_f64(vb, vb, 1);
+            float64x2_t vmax = vmaxq_f64(va, vb);
+            vst1q_f64(a + i, vminq_f64(va, vb));
+            vst1q_f64(b + len - 2 - i, vextq_f64(vmax, vmax, 1));
+        }
+#endif
+        for (; i < len; i++) {
+            double va = a[i], vb = b[len - 1 - i];
+            a[i] = std::min(va, vb);
+            b[len - 1 - i] = std::max(va, vb);
+        }
+    }
+
+    /* Ascending bitonic sort of a power of two sized buffer.  Every
+     * comparator points the same way, so each stage is a run of
+     * contiguous block compares that map directly onto SIMD lanes. */
+    static void bitonicSort(double *a,
+                            int size) {
+        int i, j, k;
+
+        for (k = 2; k <= size; k <<= 1) {
+            for (i = 0; i < size; i += k)
+                compareFlip(a + i, a + i + k / 2, k / 2);
+            for (j = k / 4; j >= 1; j >>= 1) {
+                for (i = 0; i < size; i += 2 * j)
+                    compareBlock(a + i, a + i + j, j);
+            }
+        }
+    }
+
+    int sortSmall(double *data,
+                  int n,
+                  int sortorder) {
+        int i, size;
+        double buffer[SMALL_SORT_MAX];
+
+        if (!data || n < 0)
+            return 1;
+        if (sortorder != L_SORT_INCREASING && sortorder != L_SORT_DECREASING)
+            return 1;
+
+        if (n > SMALL_SORT_MAX) {
+            if (sortorder == L_SORT_INCREASING)
+                std::sort(data, data + n);
+            else
+                std::sort(data, data + n, std::greater<double>());
+            return 0;
+        }
+        if (n < 2)
+            return 0;
+
+        /* Pad to the next power of two with +inf, which sorts last */
+        for (size = 2; size < n; size <<= 1) {}
+        memcpy(buffer, data, n * sizeof(double));
+        for (i = n; i < size; i++)
+            buffer[i] = HUGE_VAL;
+
+        bitonicSort(buffer, size);
+
+        if (sortorder == L_SORT_INCREASING) {
+            memcpy(data, buffer, n * sizeof(double));
+        } else {
+            for (i = 0; i < n; i++)
+                data[i] = buffer[n - 1 - i];
+        }
+        return 0;
+    }
+}
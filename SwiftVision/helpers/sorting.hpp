@@ -0,0 +1,71 @@
+#ifndef sorting_hpp
+#define sorting_hpp
+
+#include <stdint.h>
+
+/*----------------------------------------------------------------------------*
+ *                          Sort index engines                                *
+ *                                                                            *
+ *  Index sorts produce a permutation (uint32 indices into the input) rather  *
+ *  than a sorted copy, so the same ordering can be applied to any number of  *
+ *  parallel arrays.  Keys are read through a stride (in elements), which     *
+ *  lets the x or y field of an array of DPoint be sorted in place:           *
+ *      radixSortIndex(&pts[0].y, n, 2, L_SORT_INCREASING, index, scratch)    *
+ *  All buffers are caller-owned; index and scratch must hold n entries.      *
+ *                                                                            *
+ *  The bin sort functions take integer valued, non-negative keys; a key is   *
+ *  put in bin (int)key, so nbins must be larger than the biggest key.        *
+ *                                                                            *
+ *  The small sort function sorts values (not indices) in place with a       *
+ *  bitonic sorting network, using SSE2 or NEON min/max when available.       *
+ *  Arrays longer than SMALL_SORT_MAX fall back to std::sort.                 *
+ *----------------------------------------------------------------------------*/
+
+/*! Largest array handled by the sorting networks */
+enum {
+    SMALL_SORT_MAX = 64
+};
+
+namespace sorting {
+    /* Stable LSD radix sort on IEEE-754 keys (11 bits per pass) */
+    int radixSortIndex(const double *keys,
+                       int n,
+                       int stride,
+                       int sortorder,
+                       uint32_t *index,
+                       uint32_t *scratch);
+    int radixSortIndex(const float *keys,
+                       int n,
+                       int stride,
+                       int sortorder,
+                       uint32_t *index,
+                       uint32_t *scratch);
+
+    /* Stable counting sort: one histogram pass, one prefix sum over
+     * counts (nbins entries) and one scatter pass into index */
+    int binSortIndex(const double *keys,
+                     int n,
+                     int sortorder,
+                     uint32_t *counts,
+                     int nbins,
+                     uint32_t *index);
+
+    /* Cumulative histogram of the keys: cdf[i] = #keys in bins 0..i */
+    int binHistogram(const double *keys,
+                     int n,
+                     uint32_t *cdf,
+                     int nbins);
+
+    /* Rank lookup on a cumulative histogram.  The query is a binary search
+     * over the bins, so its cost doesn't depend on the number of samples. */
+    int histogramRankValue(const uint32_t *cdf,
+                           int nbins,
+                           double fract,
+                           double *pval);
+
+    int sortSmall(double *data,
+                  int n,
+                  int sortorder);
+}
+
+#endif /* sorting_hpp */
@@ -0,0 +1,150 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "stats.hpp"
+
+namespace stats {
+    /* Ranges at or below this size are finished with an insertion sort */
+    static const int kSelectInsertionThreshold = 16;
+
+    static int rankIndex(double fract, int n) {
+        return (int)(fract * (double)(n - 1) + 0.5);
+    }
+
+    static void insertionSort(double *a,
+                              int lo,
+                              int hi) {
+        int i, j;
+        double val;
+
+        for (i = lo + 1; i <= hi; i++) {
+            val = a[i];
+            for (j = i - 1; j >= lo && a[j] > val; j--)
+                a[j + 1] = a[j];
+            a[j + 1] = val;
+        }
+    }
+
+    /* Introselect: quickselect with a median-of-3 pivot, falling back
+     * to a heap based selection (std::partial_sort) if the recursion
+     * depth exceeds 2 * log2(n).  On return a[k] holds the k-th smallest
+     * value, everything before it is <= a[k] and everything after it
+     * is >= a[k]. */
+    static void introselect(double *a,
+                            int n,
+                            int k) {
+        int lo, hi, mid, i, j, depth;
+        double pivot;
+
+        depth = 0;
+        for (i = n; i > 1; i >>= 1)
+            depth += 2;
+
+        lo = 0;
+        hi = n - 1;
+        while (hi - lo > kSelectInsertionThreshold) {
+            if (depth-- == 0) {
+                std::partial_sort(a + lo, a + k + 1, a + hi + 1);
+                return;
+            }
+
+            /* Order a[lo] <= a[mid] <= a[hi]; these also act as
+             * sentinels for the partition scans below. */
+            mid = lo + (hi - lo) / 2;
+            if (a[mid] < a[lo]) std::swap(a[mid], a[lo]);
+            if (a[hi] < a[lo]) std::swap(a[hi], a[lo]);
+            if (a[hi] < a[mid]) std::swap(a[hi], a[mid]);
+            pivot = a[mid];
+
+            i = lo;
+            j = hi;
+            while (i <= j) {
+                while (a[i] < pivot) i++;
+                while (a[j] > pivot) j--;
+                if (i <= j) {
+                    std::swap(a[i], a[j]);
+                    i++;
+                    j--;
+                }
+            }
+
+            /* [lo, j] <= pivot, [i, hi] >= pivot, and anything
+             * in between is equal to the pivot. */
+            if (k <= j)
+                hi = j;
+            else if (k >= i)
+                lo = i;
+            else
+                return;
+        }
+        insertionSort(a, lo, hi);
+    }
+
+    int select(double *data,
+               int n,
+               int k,
+               double *pval) {
+        if (!pval)
+            return 1;
+        *pval = 0.0;  /* init */
+        if (!data || n <= 0)
+            return 1;
+        if (k < 0 || k >= n)
+            return 1;
+
+        introselect(data, n, k);
+        *pval = data[k];
+        return 0;
+    }
+
+    int getRankValue(const double *data,
+                     int n,
+                     double fract,
+                     double *scratch,
+                     double *pval) {
+        if (!pval)
+            return 1;
+        *pval = 0.0;  /* init */
+        if (!data || !scratch || n <= 0)
+            return 1;
+        if (fract < 0.0 || fract > 1.0)
+            return 1;
+
+        if (scratch != data)
+            memcpy(scratch, data, n * sizeof(double));
+        return select(scratch, n, rankIndex(fract, n), pval);
+    }
+
+    int getMedian(const double *data,
+                  int n,
+                  double *scratch,
+                  double *pval) {
+        return getRankValue(data, n, 0.5, scratch, pval);
+    }
+
+    int getMedianVariation(const double *data,
+                           int n,
+                           double *scratch,
+                           double *pmedval,
+                           double *pmedvar) {
+        int i;
+        double medval;
+
+        if (pmedval) *pmedval = 0.0;
+        if (!pmedvar)
+            return 1;
+        *pmedvar = 0.0;
+        if (!data || !scratch || n <= 0)
+            return 1;
+
+        if (getMedian(data, n, scratch, &medval))
+            return 1;
+        if (pmedval) *pmedval = medval;
+
+        /* The scratch buffer is only partitioned, so it still holds every
+         * input value; overwrite it with the absolute deviations. */
+        for (i = 0; i < n; i++)
+            scratch[i] = fabs(scratch[i] - medval);
+        return select(scratch, n, rankIndex(0.5, n), pmedvar);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef stats_hpp
+#define stats_hpp
+
+/*----------------------------------------------------------------------------*
+ *                         Rank statistics engine                             *
+ *                                                                            *
+ *  Selection based replacements for the "copy, sort, index" pattern used     *
+ *  by dewarp::getRankValue.  All functions work on caller-owned buffers:     *
+ *  the input is never modified, and the caller supplies a scratch buffer     *
+ *  of at least n doubles that is reordered in place.  Passing the input      *
+ *  itself as the scratch buffer is allowed when the caller doesn't mind      *
+ *  it being reordered.                                                       *
+ *                                                                            *
+ *  Ranks are chosen exactly as dewarp::getRankValue does it:                 *
+ *      index = (int)(fract * (n - 1) + 0.5)                                  *
+ *----------------------------------------------------------------------------*/
+
+namespace stats {
+    int select(double *data,
+               int n,
+               int k,
+               double *pval);
+
+    int getRankValue(const double *data,
+                     int n,
+                     double fract,
+                     double *scratch,
+                     double *pval);
+
+    int getMedian(const double *data,
+                  int n,
+                  double *scratch,
+                  double *pval);
+
+    int getMedianVariation(const double *data,
+                           int n,
+                           double *scratch,
+                           double *pmedval,
+                           double *pmedvar);
+}
+
+#endif /* stats_hpp */
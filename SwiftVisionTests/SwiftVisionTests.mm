@@ -1,4 +1,18 @@
 #import <XCTest/XCTest.h>
+#import <opencv2/opencv.hpp>
+#import "benchmark.hpp"
+#import "dewarp.hpp"
+#import "PtraArray.hpp"
+#import "DewarpModel.hpp"
+#import "Arena.hpp"
+#import "ContourBatch.hpp"
+#import "BlobScan.hpp"
+#import "PointGrid.hpp"
+#import "StreamingTextDewarper.h"
+#import "TextDewarperConfiguration.h"
+#import "UIImage+Mat.h"
+#import "DisparityModel.h"
+#import "remap.hpp"
 
 @interface SwiftVisionTests : XCTestCase
 
@@ -12,4 +26,652 @@
 - (void)tearDown {
     [super tearDown];
 }
+
+#pragma mark - helpers against the code they replaced
+
+- (void)testRankStatistics {
+    XCTAssertEqual(benchmark::rankStatistics(10), 0);
+}
+
+- (void)testSmallSorts {
+    XCTAssertEqual(benchmark::smallSorts(10), 0);
+}
+
+- (void)testQuadraticFits {
+    XCTAssertEqual(benchmark::quadraticFits(10), 0);
+}
+
+- (void)testMarginFits {
+    XCTAssertEqual(benchmark::marginFits(10), 0);
+}
+
+- (void)testVerticalRemaps {
+    XCTAssertEqual(benchmark::verticalRemaps(1), 0);
+}
+
+- (void)testScaleByIntegers {
+    XCTAssertEqual(benchmark::scaleByIntegers(1), 0);
+}
+
+- (void)testDisparityFits {
+    XCTAssertEqual(benchmark::disparityFits(2), 0);
+}
+
+- (void)testContourEdges {
+    XCTAssertEqual(benchmark::contourEdges(1), 0);
+}
+
+#pragma mark - dewarp
+
+- (void)testSortSmallSizes {
+    int sizes[] = {0, 1, 64};
+
+    for (int k = 0; k < 3; k++) {
+        std::vector<double> na(sizes[k]), expected;
+        for (int i = 0; i < sizes[k]; i++)
+            na[i] = rand() % 100;
+        expected = na;
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<double> *sorted = dewarp::sort(NULL, &na, L_SORT_INCREASING);
+        XCTAssertTrue(sorted != NULL, @"%d values", sizes[k]);
+        if (sorted)
+            XCTAssertTrue(*sorted == expected, @"%d values", sizes[k]);
+        delete sorted;
+
+        /* in place */
+        std::reverse(expected.begin(), expected.end());
+        XCTAssertEqual(dewarp::sort(&na, &na, L_SORT_DECREASING), &na);
+        XCTAssertTrue(na == expected, @"%d values", sizes[k]);
+    }
+}
+
+#pragma mark - PtrArray
+
+- (void)testPtraRemoveCompaction {
+    static int items[3];
+    PtrArray *pa = dewarp::ptraCreate(4);
+    int imax;
+
+    for (int i = 0; i < 3; i++)
+        dewarp::ptraInsert(pa, i, &items[i], L_MIN_DOWNSHIFT);
+    XCTAssertEqual(dewarp::ptraRemove(pa, 0, L_COMPACTION), &items[0]);
+    dewarp::ptraGetMaxIndex(pa, &imax);
+    XCTAssertEqual(imax, 1);
+    XCTAssertEqual(pa->array[0], &items[1]);
+    XCTAssertEqual(pa->array[1], &items[2]);
+    /* nothing left behind above the new end */
+    XCTAssertTrue(pa->array[2] == NULL);
+    dewarp::ptraDestroy(&pa, 0, 0);
+}
+
+#pragma mark - Arena
+
+- (void)testArenaScopesNest {
+    Arena arena;
+    size_t nallocs;
+
+    for (int cycle = 0; cycle < 2; cycle++) {
+        nallocs = arena.allocationCount();
+        {
+            ArenaScope outer(&arena);
+            double *kept = arena.alloc<double>(1000);
+            kept[999] = 1.0;
+            /* an odd offset first, so the alignment has work to do */
+            arena.allocate(24, 8);
+            XCTAssertEqual((uintptr_t)arena.allocate(100, 64) % 64, (uintptr_t)0);
+            XCTAssertEqual((uintptr_t)arena.allocate(100, 256) % 256, (uintptr_t)0);
+            {
+                /* grows the arena by another block */
+                ArenaScope inner(&arena);
+                arena.alloc<double>(100000);
+            }
+            XCTAssertEqual(kept[999], 1.0);
+            arena.alloc<double>(5000);
+        }
+        XCTAssertEqual(arena.mark(), (size_t)0);
+        /* the outermost release folds the blocks into one, so the
+         * second cycle fits without going to the heap */
+        if (cycle > 0)
+            XCTAssertEqual(arena.allocationCount() - nallocs, (size_t)0);
+    }
+}
+
+#pragma mark - ContourBatch
+
+/* Outlines of filled, rotated ellipses and rectangles, plus one pixel
+ * lines whose outlines double back on themselves */
+static std::vector<std::vector<cv::Point> > testContours() {
+    cv::Mat image = cv::Mat::zeros(600, 800, CV_8UC1);
+    cv::RNG rng(12345);
+    std::vector<std::vector<cv::Point> > contours;
+
+    for (int i = 0; i < 12; i++) {
+        cv::Point center(60 + (i % 4) * 190, 60 + (i / 4) * 150);
+        cv::Size axes(rng.uniform(30, 80), rng.uniform(4, 15));
+        cv::ellipse(image, center, axes, rng.uniform(-60.0, 60.0), 0, 360, cv::Scalar(255), cv::FILLED);
+    }
+    cv::rectangle(image, cv::Rect(20, 480, 150, 30), cv::Scalar(255), cv::FILLED);
+    cv::line(image, cv::Point(250, 500), cv::Point(400, 540), cv::Scalar(255), 1);
+    cv::line(image, cv::Point(450, 560), cv::Point(700, 470), cv::Scalar(255), 1);
+    cv::findContours(image, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+    return contours;
+}
+
+- (void)testContourBatchMatchesOpenCV {
+    std::vector<std::vector<cv::Point> > contours = testContours();
+    ContourBatch batch;
+    int k, i, col;
+
+    for (k = 0; k < (int)contours.size(); k++)
+        batch.add(&contours[k][0].x, (int)contours[k].size());
+    XCTAssertEqual(batch.compute(CONTOUR_PROFILE), 0);
+    XCTAssertEqual(batch.count(), 15);
+
+    for (k = 0; k < batch.count(); k++) {
+        const std::vector<cv::Point> &contour = contours[k];
+        cv::Rect bounds = cv::boundingRect(contour);
+        XCTAssertEqual(batch.boundsX(k), bounds.x);
+        XCTAssertEqual(batch.boundsY(k), bounds.y);
+        XCTAssertEqual(batch.boundsWidth(k), bounds.width);
+        XCTAssertEqual(batch.boundsHeight(k), bounds.height);
+
+        /* the mask reduction Contour and ContourSpan used to do */
+        cv::Mat mask = cv::Mat::zeros(bounds.height, bounds.width, CV_32FC1);
+        for (i = 0; i < (int)contour.size(); i++)
+            mask.at<float>(contour[i].y - bounds.y, contour[i].x - bounds.x) = 1.0;
+        cv::Mat weighted = mask.clone();
+        for (i = 0; i < mask.rows; i++)
+            weighted.row(i) *= i;
+        cv::Mat counts, totals;
+        double thickness;
+        cv::reduce(mask, counts, 0, cv::REDUCE_SUM, CV_64FC1);
+        cv::reduce(weighted, totals, 0, cv::REDUCE_SUM, CV_64FC1);
+        cv::minMaxLoc(counts, NULL, &thickness);
+        XCTAssertEqual(batch.thickness(k), (int)thickness);
+        for (col = 0; col < bounds.width; col++) {
+            double mean = totals.at<double>(0, col) / counts.at<double>(0, col);
+            XCTAssertEqualWithAccuracy(batch.columnMeans(k)[col], mean, 1e-4);
+        }
+
+        /* the moments, tangent and clx of the old Contour; it had
+         * nothing sensible for the outlines without area */
+        cv::Moments m = cv::moments(contour);
+        if (m.m00 == 0.0)
+            continue;
+        XCTAssertEqualWithAccuracy(batch.area(k), m.m00, 1e-9 * m.m00);
+        XCTAssertEqualWithAccuracy(batch.centerX(k), m.m10 / m.m00, 1e-9);
+        XCTAssertEqualWithAccuracy(batch.centerY(k), m.m01 / m.m00, 1e-9);
+
+        double data[4] = {m.mu20, m.mu11, m.mu11, m.mu02};
+        cv::Mat covariance = cv::Mat(2, 2, CV_64FC1, data) / m.m00;
+        cv::Mat w, u, vt;
+        cv::SVDecomp(covariance, w, u, vt);
+        double ux = u.at<double>(0, 0);
+        double uy = u.at<double>(1, 0);
+        /* the batch orients the tangent, SVDecomp() doesn't */
+        if (ux < 0.0 || (ux == 0.0 && uy < 0.0)) {
+            ux = -ux;
+            uy = -uy;
+        }
+        XCTAssertEqualWithAccuracy(batch.tangentX(k), ux, 1e-9);
+        XCTAssertEqualWithAccuracy(batch.tangentY(k), uy, 1e-9);
+
+        std::vector<double> dots;
+        for (i = 0; i < (int)contour.size(); i++)
+            dots.push_back(ux * (contour[i].x - m.m10 / m.m00) + uy * (contour[i].y - m.m01 / m.m00));
+        double dmin = *std::min_element(dots.begin(), dots.end());
+        double dmax = *std::max_element(dots.begin(), dots.end());
+        XCTAssertEqualWithAccuracy(batch.clxMin(k), dmin, 1e-6);
+        XCTAssertEqualWithAccuracy(batch.clxMax(k), dmax, 1e-6);
+    }
+}
+
+#pragma mark - BlobScan
+
+/* Labels the 8-connected blobs of image by flood fill, numbering them
+ * in the order of their first pixel; returns the count */
+static int floodFillLabels(const std::vector<uint8_t> &image,
+                           int width,
+                           int height,
+                           std::vector<int> *plabels) {
+    std::vector<int> &labels = *plabels;
+    std::vector<int> stack;
+    int nblobs = 0;
+
+    labels.assign(image.size(), -1);
+    for (int start = 0; start < width * height; start++) {
+        if (!image[start] || labels[start] >= 0)
+            continue;
+        labels[start] = nblobs;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int p = stack.back();
+            stack.pop_back();
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int x = p % width + dx, y = p / width + dy;
+                    if (x < 0 || x >= width || y < 0 || y >= height)
+                        continue;
+                    if (image[y * width + x] && labels[y * width + x] < 0) {
+                        labels[y * width + x] = nblobs;
+                        stack.push_back(y * width + x);
+                    }
+                }
+            }
+        }
+        nblobs++;
+    }
+    return nblobs;
+}
+
+- (void)testBlobScanMatchesFloodFill {
+    const int width = 157, height = 93;
+    std::vector<uint8_t> image(width * height);
+    std::vector<int> labels;
+    BlobScan scan;
+    int k, p, nblobs;
+
+    /* dense enough noise that blobs merge late, through U shapes and
+     * diagonals */
+    srand(7);
+    for (p = 0; p < width * height; p++)
+        image[p] = (rand() % 100 < 40) ? 255 : 0;
+    nblobs = floodFillLabels(image, width, height, &labels);
+    XCTAssertGreaterThan(nblobs, 100);
+    XCTAssertEqual(scan.scan(&image[0], width, height, width), 0);
+    XCTAssertEqual(scan.count(), nblobs);
+
+    std::vector<int> area(nblobs, 0), xmin(nblobs, width), xmax(nblobs, -1), ymin(nblobs, height), ymax(nblobs, -1);
+    std::vector<double> m10(nblobs, 0.0), m01(nblobs, 0.0);
+    for (p = 0; p < width * height; p++) {
+        if ((k = labels[p]) < 0)
+            continue;
+        area[k]++;
+        m10[k] += p % width;
+        m01[k] += p / width;
+        xmin[k] = std::min(xmin[k], p % width);
+        xmax[k] = std::max(xmax[k], p % width);
+        ymin[k] = std::min(ymin[k], p / width);
+        ymax[k] = std::max(ymax[k], p / width);
+    }
+    for (k = 0; k < std::min(nblobs, scan.count()); k++) {
+        const BlobStats &blob = scan.blob(k);
+        XCTAssertEqual(blob.area, area[k]);
+        XCTAssertEqual(blob.x, xmin[k]);
+        XCTAssertEqual(blob.y, ymin[k]);
+        XCTAssertEqual(blob.width, xmax[k] - xmin[k] + 1);
+        XCTAssertEqual(blob.height, ymax[k] - ymin[k] + 1);
+        XCTAssertEqual(blob.m10, m10[k]);
+        XCTAssertEqual(blob.m01, m01[k]);
+    }
+
+    /* erasing every other blob leaves exactly the pixels of the rest */
+    std::vector<uint8_t> keep(scan.count());
+    for (k = 0; k < scan.count(); k++)
+        keep[k] = k % 2;
+    XCTAssertEqual(scan.erase(&keep[0], &image[0], width), 0);
+    int wrong = 0;
+    for (p = 0; p < width * height; p++)
+        wrong += (image[p] != 0) != (labels[p] >= 0 && labels[p] % 2 == 1);
+    XCTAssertEqual(wrong, 0);
+    XCTAssertEqual(scan.scan(&image[0], width, height, width), 0);
+    XCTAssertEqual(scan.count(), nblobs / 2);
+}
+
+#pragma mark - PointGrid
+
+/* The i > j loop over every pair that PointGrid::pairsWithin replaced */
+static std::vector<std::pair<int, int> > allPairsWithin(const std::vector<double> &startx,
+                                                        const std::vector<double> &starty,
+                                                        const std::vector<double> &endx,
+                                                        const std::vector<double> &endy,
+                                                        double radius) {
+    std::vector<std::pair<int, int> > pairs;
+    int n = (int)startx.size();
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            double ax = startx[j] - endx[i], ay = starty[j] - endy[i];
+            double bx = startx[i] - endx[j], by = starty[i] - endy[j];
+            if (ax * ax + ay * ay <= radius * radius || bx * bx + by * by <= radius * radius)
+                pairs.push_back(std::make_pair(i, j));
+        }
+    }
+    return pairs;
+}
+
+- (void)testPointGridPairsMatchAllPairs {
+    std::vector<double> sx, sy, ex, ey;
+    std::vector<std::pair<int, int> > pairs;
+    double radii[] = {0.0, 1.0, 5.0, 12.5, 40.0, 1000.0};
+
+    /* no points */
+    XCTAssertEqual(PointGrid::pairsWithin(NULL, NULL, NULL, NULL, 0, 5.0, &pairs), 1);
+    double none = 0.0;
+    XCTAssertEqual(PointGrid::pairsWithin(&none, &none, &none, &none, 0, 5.0, &pairs), 0);
+    XCTAssertTrue(pairs.empty());
+
+    /* on a small integer grid, so many points coincide or sit exactly
+     * radius apart; the ends are near the starts, as on a text line */
+    srand(11);
+    for (int i = 0; i < 400; i++) {
+        sx.push_back(rand() % 120);
+        sy.push_back(rand() % 60);
+        ex.push_back(sx[i] + rand() % 10);
+        ey.push_back(sy[i] + rand() % 7 - 3);
+    }
+    for (int r = 0; r < (int)(sizeof(radii) / sizeof(radii[0])); r++) {
+        for (int n = 1; n <= 400; n *= 20) {
+            std::vector<double> nsx(sx.begin(), sx.begin() + n), nsy(sy.begin(), sy.begin() + n);
+            std::vector<double> nex(ex.begin(), ex.begin() + n), ney(ey.begin(), ey.begin() + n);
+            XCTAssertEqual(PointGrid::pairsWithin(&nsx[0], &nsy[0], &nex[0], &ney[0], n, radii[r], &pairs), 0);
+            XCTAssertTrue(pairs == allPairsWithin(nsx, nsy, nex, ney, radii[r]),
+                          @"radius %g, %d points", radii[r], n);
+        }
+    }
+
+    /* 3-4-5 apart, found from either end, and only once */
+    double startx[] = {0.0, 3.0}, starty[] = {0.0, 4.0};
+    double endx[] = {100.0, 100.0}, endy[] = {100.0, 100.0};
+    XCTAssertEqual(PointGrid::pairsWithin(startx, starty, endx, endy, 2, 5.0, &pairs), 0);
+    XCTAssertTrue(pairs.empty());
+    endx[0] = 0.0; endy[0] = 0.0;
+    XCTAssertEqual(PointGrid::pairsWithin(startx, starty, endx, endy, 2, 5.0, &pairs), 0);
+    XCTAssertTrue(pairs.size() == 1 && pairs[0] == std::make_pair(1, 0));
+    endx[0] = 100.0; endy[0] = 100.0; endx[1] = 3.0; endy[1] = 4.0;
+    XCTAssertEqual(PointGrid::pairsWithin(startx, starty, endx, endy, 2, 5.0, &pairs), 0);
+    XCTAssertTrue(pairs.size() == 1 && pairs[0] == std::make_pair(1, 0));
+    endx[0] = 0.0; endy[0] = 0.0;
+    XCTAssertEqual(PointGrid::pairsWithin(startx, starty, endx, endy, 2, 5.0, &pairs), 0);
+    XCTAssertTrue(pairs.size() == 1 && pairs[0] == std::make_pair(1, 0));
+    XCTAssertEqual(PointGrid::pairsWithin(startx, starty, endx, endy, 2, 4.99, &pairs), 0);
+    XCTAssertTrue(pairs.empty());
+}
+
+#pragma mark - DewarpModel
+
+- (void)testDewarpModelByteOrder {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"byteorder.svdm"];
+    DewarpModel model, loaded, swapped;
+    uint32_t magic = DEWARP_MODEL_MAGIC_SWAPPED;
+
+    model.width = 100;
+    model.height = 120;
+    model.sampling = 20;
+    model.vertical.resize(6, 7);
+    model.columnFits.resize(3, 6);
+    XCTAssertEqual(model.save(path.fileSystemRepresentation), 0);
+    XCTAssertEqual(loaded.load(path.fileSystemRepresentation), 0);
+    XCTAssertEqual(loaded.height, 120);
+
+    /* the same file as a big endian host would have written it */
+    NSMutableData *data = [NSMutableData dataWithContentsOfFile:path];
+    [data replaceBytesInRange:NSMakeRange(0, sizeof(magic)) withBytes:&magic];
+    XCTAssertTrue([data writeToFile:path atomically:YES]);
+    XCTAssertNotEqual(swapped.load(path.fileSystemRepresentation), 0);
+    XCTAssertFalse(swapped.mapped());
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testDewarpModelRejectsCorruptHeaders {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"corrupt.svdm"];
+    DewarpModel model, loaded;
+    int32_t bad[][2] = {
+        {0, 120},       /* no width */
+        {100, -5},      /* negative height */
+        {102, 120},     /* the grid stops a column short */
+        {100, 200}      /* and many rows short */
+    };
+
+    model.width = 100;
+    model.height = 120;
+    model.sampling = 20;
+    model.vertical.resize(6, 7);
+    model.columnFits.resize(3, 6);
+    XCTAssertEqual(model.save(path.fileSystemRepresentation), 0);
+    NSData *good = [NSData dataWithContentsOfFile:path];
+
+    for (int k = 0; k < 4; k++) {
+        NSMutableData *data = good.mutableCopy;
+        [data replaceBytesInRange:NSMakeRange(offsetof(DewarpModelHeader, width), sizeof(bad[k]))
+                        withBytes:bad[k]];
+        XCTAssertTrue([data writeToFile:path atomically:YES]);
+        XCTAssertNotEqual(loaded.load(path.fileSystemRepresentation), 0, @"size %d x %d", bad[k][0], bad[k][1]);
+        XCTAssertFalse(loaded.mapped());
+    }
+
+    /* cut in the header, and short of the last column fit */
+    XCTAssertTrue([[good subdataWithRange:NSMakeRange(0, 64)] writeToFile:path atomically:YES]);
+    XCTAssertNotEqual(loaded.load(path.fileSystemRepresentation), 0);
+    XCTAssertTrue([[good subdataWithRange:NSMakeRange(0, good.length - 8)] writeToFile:path atomically:YES]);
+    XCTAssertNotEqual(loaded.load(path.fileSystemRepresentation), 0);
+    XCTAssertFalse(loaded.mapped());
+
+    /* nor will save() write such a model */
+    model.width = 102;
+    XCTAssertNotEqual(model.save(path.fileSystemRepresentation), 0);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - StreamingTextDewarper
+
+/* A 1440 x 1920 page with a line of seven 110 x 20 words at each row */
+static UIImage *textFrame(const std::vector<int> &rows) {
+    cv::Mat mat(1920, 1440, CV_8UC4, cv::Scalar(255, 255, 255, 255));
+    for (int y : rows)
+        for (int x = 200; x + 110 <= 1240; x += 150)
+            cv::rectangle(mat, cv::Rect(x, y, 110, 20), cv::Scalar(0, 0, 0, 255), cv::FILLED);
+    return [UIImage imageWithMat:mat];
+}
+
+static std::vector<int> textRows(int n, int shift = 0) {
+    std::vector<int> rows;
+    for (int k = 0; k < n; k++)
+        rows.push_back(300 + 120 * k + shift);
+    return rows;
+}
+
+- (void)testStreamingKeepsAndRefitsLines {
+    StreamingTextDewarper *dewarper = [[StreamingTextDewarper alloc] initWithConfiguration:[TextDewarperConfiguration new]];
+    std::vector<int> rows = textRows(10);
+
+    /* the first frame is processed from scratch */
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 10u);
+    XCTAssertEqual(dewarper.refittedLineCount, 10u);
+    XCTAssertTrue(dewarper.refittedModel);
+
+    /* the same frame keeps every line and the model */
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 10u);
+    XCTAssertEqual(dewarper.refittedLineCount, 0u);
+    XCTAssertFalse(dewarper.refittedModel);
+
+    /* one line moving by more than TRACK_MAX_SHIFT is fitted again */
+    rows[4] += 4;
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 10u);
+    XCTAssertEqual(dewarper.refittedLineCount, 1u);
+    XCTAssertTrue(dewarper.refittedModel);
+
+    /* and then all but that one */
+    rows = textRows(10, 4);
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 10u);
+    XCTAssertEqual(dewarper.refittedLineCount, 9u);
+
+    /* a line panning into view starts a new line */
+    rows.push_back(rows.back() + 120);
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 11u);
+    XCTAssertEqual(dewarper.refittedLineCount, 1u);
+    XCTAssertTrue(dewarper.refittedModel);
+
+    /* reset starts over */
+    [dewarper reset];
+    XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+    XCTAssertEqual(dewarper.rebuildCount, 1u);
+    XCTAssertEqual(dewarper.trackedLineCount, 11u);
+}
+
+- (void)testStreamingRebuildsPastUnmatchedContours {
+    /* lines half way between the tracked ones match none of them: 3 of
+     * them leave 21 of 91 contours unmatched, 5 leave 35 of 105 */
+    for (int extra : {3, 5}) {
+        StreamingTextDewarper *dewarper = [[StreamingTextDewarper alloc] initWithConfiguration:[TextDewarperConfiguration new]];
+        std::vector<int> rows = textRows(10);
+        [dewarper dewarpFrame:textFrame(rows)];
+        XCTAssertEqual(dewarper.trackedLineCount, 10u);
+
+        for (int k = 0; k < extra; k++)
+            rows.push_back(360 + 240 * k);
+        XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+        XCTAssertEqual(dewarper.rebuildCount, extra == 3 ? 1u : 2u, @"%d extra lines", extra);
+        XCTAssertEqual(dewarper.trackedLineCount, (NSUInteger)(10 + extra), @"%d extra lines", extra);
+    }
+}
+
+- (void)testStreamingRebuildsPastLostLines {
+    /* 2 of 10 lines gone is within TRACK_MAX_LOST, 3 is not */
+    for (int gone : {2, 3}) {
+        StreamingTextDewarper *dewarper = [[StreamingTextDewarper alloc] initWithConfiguration:[TextDewarperConfiguration new]];
+        std::vector<int> rows = textRows(10);
+        [dewarper dewarpFrame:textFrame(rows)];
+        XCTAssertEqual(dewarper.trackedLineCount, 10u);
+
+        rows.erase(rows.begin() + 3, rows.begin() + 3 + gone);
+        XCTAssertNotNil([dewarper dewarpFrame:textFrame(rows)]);
+        XCTAssertEqual(dewarper.rebuildCount, gone == 2 ? 1u : 2u, @"%d lines gone", gone);
+        XCTAssertEqual(dewarper.trackedLineCount, (NSUInteger)(10 - gone), @"%d lines gone", gone);
+        XCTAssertTrue(dewarper.refittedModel);
+    }
+}
+
+#pragma mark - DisparityModel
+
+/* A smooth RGBA page and a model fitted to twenty lines that sag
+ * towards the middle of the page */
+static DisparityModel *curvedPageModel(UIImage **pimage) {
+    cv::Mat mat(1920, 1440, CV_8UC4);
+    for (int i = 0; i < mat.rows; i++) {
+        for (int j = 0; j < mat.cols; j++)
+            mat.at<cv::Vec4b>(i, j) = cv::Vec4b((uchar)(127.5 + 100.0 * sin(0.07 * j)),
+                                                (uchar)(127.5 + 100.0 * cos(0.05 * i)),
+                                                (uchar)((i + 2 * j) & 0xff), 255);
+    }
+    std::vector<std::vector<cv::Point2d>> keyPoints(20);
+    for (int k = 0; k < 20; k++) {
+        for (double x = 160.0; x <= 1280.0; x += 40.0)
+            keyPoints[k].push_back(cv::Point2d(x, 200.0 + 80.0 * k + 4.0e-5 * (x - 720.0) * (x - 720.0)));
+    }
+    *pimage = [UIImage imageWithMat:mat];
+    return [[DisparityModel alloc] initWithImage:*pimage keyPoints:keyPoints];
+}
+
+- (void)testDewarpViewConvertsIntoPaddedRows {
+    UIImage *image;
+    DisparityModel *model = curvedPageModel(&image);
+    cv::Mat src = [image mat];
+    remap::ConstImageView srcView = { src.data, src.cols, src.rows, (int)src.step, remap::PIXEL_RGBA8 };
+
+    DewarpOutput optionSets[] = { DewarpOutputDewarped, DewarpOutputDewarped | DewarpOutputBilinear };
+    for (DewarpOutput options : optionSets) {
+        cv::Mat expected = [[model apply:options toImage:image] mat];
+        XCTAssertEqual(expected.cols, src.cols);
+        XCTAssertEqual(expected.rows, src.rows);
+
+        /* rows padded to an odd stride, into luma and into BGR */
+        int grayStride = src.cols + 37, bgrStride = 3 * src.cols + 29;
+        std::vector<uint8_t> gray((size_t)grayStride * src.rows, 0xab), bgr((size_t)bgrStride * src.rows, 0xab);
+        remap::ImageView grayView = { gray.data(), src.cols, src.rows, grayStride, remap::PIXEL_GRAY8 };
+        remap::ImageView bgrView = { bgr.data(), src.cols, src.rows, bgrStride, remap::PIXEL_BGR8 };
+        XCTAssertTrue([model dewarpView:&srcView intoView:&grayView options:options]);
+        XCTAssertTrue([model dewarpView:&srcView intoView:&bgrView options:options]);
+
+        int ngray = 0, nbgr = 0, npad = 0;
+        for (int i = 0; i < src.rows; i++) {
+            const uint8_t *line = expected.ptr<uint8_t>(i);
+            const uint8_t *lineg = gray.data() + (size_t)i * grayStride;
+            const uint8_t *lineb = bgr.data() + (size_t)i * bgrStride;
+            for (int j = 0; j < src.cols; j++) {
+                int r = line[4 * j], g = line[4 * j + 1], b = line[4 * j + 2];
+                ngray += lineg[j] != ((77 * r + 150 * g + 29 * b + 128) >> 8);
+                nbgr += lineb[3 * j] != b || lineb[3 * j + 1] != g || lineb[3 * j + 2] != r;
+            }
+            /* the padding is left alone */
+            for (int j = src.cols; j < grayStride; j++)
+                npad += lineg[j] != 0xab;
+            for (int j = 3 * src.cols; j < bgrStride; j++)
+                npad += lineb[j] != 0xab;
+        }
+        XCTAssertEqual(ngray, 0, @"options %lu", (unsigned long)options);
+        XCTAssertEqual(nbgr, 0, @"options %lu", (unsigned long)options);
+        XCTAssertEqual(npad, 0, @"options %lu", (unsigned long)options);
+    }
+
+    /* a view of another size is refused and left as is */
+    std::vector<uint8_t> small((size_t)src.cols * (src.rows - 1), 0xab);
+    remap::ImageView smallView = { small.data(), src.cols, src.rows - 1, src.cols, remap::PIXEL_GRAY8 };
+    XCTAssertFalse([model dewarpView:&srcView intoView:&smallView options:DewarpOutputDewarped]);
+    XCTAssertEqual(std::count(small.begin(), small.end(), 0xab), (long)small.size());
+}
+
+/* The same smooth page rendered at `scale` times 720 x 960 */
+static UIImage *scaledPage(double scale) {
+    cv::Mat mat((int)(960 * scale + 0.5), (int)(720 * scale + 0.5), CV_8UC4);
+    for (int i = 0; i < mat.rows; i++) {
+        double y = (i + 0.5) / scale - 0.5;
+        for (int j = 0; j < mat.cols; j++) {
+            double x = (j + 0.5) / scale - 0.5;
+            cv::Vec4b &p = mat.at<cv::Vec4b>(i, j);
+            for (int k = 0; k < 3; k++)
+                p[k] = (uchar)(128.0 + 100.0 * sin(0.03 * x + k) * cos(0.02 * y + 0.5 * k));
+            p[3] = 255;
+        }
+    }
+    return [UIImage imageWithMat:mat];
+}
+
+- (void)testApplyToLargerImages {
+    /* Fitted at 720 x 960 and applied at 2x and at 1.5x: the larger
+     * dewarp, scaled back down, is the working one to within the
+     * resampling of the two images. */
+    std::vector<std::vector<cv::Point2d>> keyPoints(12);
+    for (int k = 0; k < 12; k++) {
+        for (double x = 80.0; x <= 640.0; x += 20.0)
+            keyPoints[k].push_back(cv::Point2d(x, 100.0 + 65.0 * k + 8.0e-5 * (x - 360.0) * (x - 360.0)));
+    }
+    UIImage *working = scaledPage(1.0);
+    DisparityModel *model = [[DisparityModel alloc] initWithImage:working keyPoints:keyPoints];
+    DewarpOutput options = DewarpOutputDewarped | DewarpOutputBilinear;
+    cv::Mat expected = [[model apply:options toImage:working] mat];
+
+    for (double scale : { 2.0, 1.5 }) {
+        UIImage *large = scaledPage(scale);
+        cv::Mat dewarped = [[model apply:options toImage:large] mat], reduced;
+        XCTAssertEqual(dewarped.cols, (int)(720 * scale + 0.5));
+        XCTAssertEqual(dewarped.rows, (int)(960 * scale + 0.5));
+        cv::resize(dewarped, reduced, expected.size(), 0, 0, cv::INTER_LINEAR);
+
+        double maxdiff = 0.0, sum = 0.0;
+        for (int i = 0; i < expected.rows; i++) {
+            for (int j = 0; j < expected.cols; j++) {
+                for (int k = 0; k < 3; k++) {
+                    double d = fabs((double)expected.at<cv::Vec4b>(i, j)[k] - reduced.at<cv::Vec4b>(i, j)[k]);
+                    maxdiff = std::max(maxdiff, d);
+                    sum += d;
+                }
+            }
+        }
+        double mean = sum / (3.0 * expected.total());
+        XCTAssertLessThanOrEqual(maxdiff, 4.0, @"scale %.1f", scale);
+        XCTAssertLessThanOrEqual(mean, 0.75, @"scale %.1f", scale);
+    }
+}
 @end
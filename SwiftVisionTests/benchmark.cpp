@@ -0,0 +1,808 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "benchmark.hpp"
+#include "dewarp.hpp"
+#include "math.hpp"
+#include "stats.hpp"
+#include "sorting.hpp"
+#include "remap.hpp"
+#include "parallel.hpp"
+#include "PointGrid.hpp"
+
+using namespace std::chrono;
+
+namespace benchmark {
+    /* Levels the one pass h + v bilinear warp may be off the exact two
+     * pass result on smoothImage() */
+    static const double kTwoPassTolerance = 2.0;
+    /* Levels the vertical bilinear warp may be off the double one: half
+     * from the 8 bit weights (1/512 of at most 255), half from rounding */
+    static const double kBilinearTolerance = 1.0;
+
+    static double elapsedUs(high_resolution_clock::time_point start, int iterations) {
+        duration<double, std::micro> elapsed = high_resolution_clock::now() - start;
+        return elapsed.count() / (double)iterations;
+    }
+
+    static void randomFill(std::vector<double> *na, double scale) {
+        for (int i = 0; i < (int)na->size(); i++)
+            (*na)[i] = scale * ((double)rand() / (double)RAND_MAX - 0.5);
+    }
+
+    static void report(char const *name, int n, double before, double after) {
+        printf("%-24s n = %-7i %12.2f us %12.2f us %8.1fx\n",
+               name, n, before, after, after > 0.0 ? before / after : 0.0);
+    }
+
+    /* The shell sort that dewarp::sort used before the sorting networks */
+    static void legacyShellSort(std::vector<double> *na) {
+        int i, j, gap, n;
+        double tmp;
+
+        n = (int)na->size();
+        for (gap = n/2; gap > 0; gap = gap / 2) {
+            for (i = gap; i < n; i++) {
+                for (j = i - gap; j >= 0; j -= gap) {
+                    if (na->at(j) > na->at(j + gap)) {
+                        tmp = na->at(j);
+                        na->at(j) = na->at(j + gap);
+                        na->at(j + gap) = tmp;
+                    }
+                }
+            }
+        }
+    }
+
+    /* The raw moment + gaussjordan quadratic fit that
+     * math::getQuadraticLSF used before the closed form solver */
+    static int legacyQuadraticLSF(const double *xs,
+                                  const double *ys,
+                                  int n,
+                                  double *pa,
+                                  double *pb,
+                                  double *pc) {
+        int i, ret;
+        double x, y, sx, sy, sx2, sx3, sx4, sxy, sx2y;
+        double *f[3];
+        double g[3];
+
+        sx = sy = sx2 = sx3 = sx4 = sxy = sx2y = 0.;
+        for (i = 0; i < n; i++) {
+            x = xs[i];
+            y = ys[i];
+            sx += x;
+            sy += y;
+            sx2 += x * x;
+            sx3 += x * x * x;
+            sx4 += x * x * x * x;
+            sxy += x * y;
+            sx2y += x * x * y;
+        }
+        for (i = 0; i < 3; i++)
+            f[i] = (double *)calloc(3, sizeof(double));
+        f[0][0] = sx4; f[0][1] = sx3; f[0][2] = sx2;
+        f[1][0] = sx3; f[1][1] = sx2; f[1][2] = sx;
+        f[2][0] = sx2; f[2][1] = sx;  f[2][2] = n;
+        g[0] = sx2y;
+        g[1] = sxy;
+        g[2] = sy;
+        ret = math::gaussjordan(f, g, 3);
+        for (i = 0; i < 3; i++)
+            free(f[i]);
+        *pa = g[0];
+        *pb = g[1];
+        *pc = g[2];
+        return ret;
+    }
+
+    static void header(char const *name) {
+        printf("\n# %s #\n", name);
+        printf("%-24s %-11s %15s %15s %9s\n", "", "", "before", "after", "speedup");
+        printf("----------------------------\n");
+    }
+
+    /* Median + MAD, as used for the line curvature outlier test.
+     * "before" is the previous copy + shell sort + index path. */
+    int rankStatistics(int iterations) {
+        int sizes[] = { 40, 120, 1000, 10000, 20000 };
+        int i, it, n, ndiff;
+        double medval, medvar, sink;
+
+        header("rank statistics (median + MAD)");
+        ndiff = 0;
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+            n = sizes[i];
+            std::vector<double> na(n), scratch(n);
+            randomFill(&na, 1.0e-3);
+            int count = n > 1000 ? 1 + iterations / 100 : iterations;
+
+            sink = 0.0;
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < count; it++) {
+                std::vector<double> nas(na);
+                legacyShellSort(&nas);
+                medval = nas[(int)(0.5 * (n - 1) + 0.5)];
+                std::vector<double> navar(n);
+                for (int j = 0; j < n; j++)
+                    navar[j] = fabs(na[j] - medval);
+                legacyShellSort(&navar);
+                sink += medval + navar[(int)(0.5 * (n - 1) + 0.5)];
+            }
+            double before = elapsedUs(start, count);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < count; it++) {
+                stats::getMedianVariation(na.data(), n, scratch.data(), &medval, &medvar);
+                sink -= medval + medvar;
+            }
+            double after = elapsedUs(start, count);
+
+            report("median variation", n, before, after);
+            if (fabs(sink) > 1.0e-9) {
+                printf("  !! results differ (%g)\n", sink);
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* A batch of small arrays shaped like the per-line and per-column
+     * sample sets of the vertical disparity fit (10 - 60 values each).
+     * "before" runs the previous dewarp::sort (shell sort), "after"
+     * sortSmall, the path dewarp::sort now takes, per array. */
+    int smallSorts(int iterations) {
+        int sizes[] = { 8, 16, 32, 64 };
+        int i, j, it, n, narrays, total, ndiff;
+        double sink;
+
+        header("small sorts (256 arrays)");
+        ndiff = 0;
+        narrays = 256;
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+            n = sizes[i];
+            std::vector<int> offsets(narrays + 1);
+            for (total = 0, j = 0; j <= narrays; j++) {
+                offsets[j] = total;
+                total += n - (j % 3);  /* mix in non power of two lengths */
+            }
+            total = offsets[narrays];
+            std::vector<double> source(total), batch(total);
+            randomFill(&source, 1000.0);
+
+            sink = 0.0;
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                for (j = 0; j < narrays; j++) {
+                    std::vector<double> na(source.begin() + offsets[j], source.begin() + offsets[j + 1]);
+                    legacyShellSort(&na);
+                    sink += na[na.size() / 2];
+                }
+            }
+            double before = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                batch = source;
+                for (j = 0; j < narrays; j++) {
+                    sorting::sortSmall(&batch[offsets[j]], offsets[j + 1] - offsets[j], L_SORT_INCREASING);
+                    sink -= batch[offsets[j] + (offsets[j + 1] - offsets[j]) / 2];
+                }
+            }
+            double after = elapsedUs(start, iterations);
+
+            report("sortSmall", n, before, after);
+            if (fabs(sink) > 1.0e-6) {
+                printf("  !! results differ (%g)\n", sink);
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* Per-line fits (nlines sets of ~40 points along x) and per-column
+     * fits (73 columns of nlines disparities sharing the same y), as in
+     * getVerticalDisparity.  "before" fits one set at a time with
+     * gaussjordan. */
+    int quadraticFits(int iterations) {
+        int sizes[] = { 20, 60, 200 };
+        int i, j, k, it, nlines, npts, nx, ndiff;
+        double a, b, c, sink;
+        Arena arena;
+
+        header("quadratic least squares fits");
+        ndiff = 0;
+        nx = 73;
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+            nlines = sizes[i];
+            std::vector<int> offsets(nlines + 1);
+            std::vector<double> xs, ys;
+            for (k = 0; k < nlines; k++) {
+                offsets[k] = (int)xs.size();
+                npts = 20 + rand() % 40;
+                double curve = 1.0e-5 * (rand() % 100 - 50);
+                for (j = 0; j < npts; j++) {
+                    double x = 1440.0 * j / npts;
+                    xs.push_back(x);
+                    ys.push_back(curve * (x - 720.0) * (x - 720.0) + 1900.0 * k / nlines);
+                }
+            }
+            offsets[nlines] = (int)xs.size();
+            std::vector<double> ca(nlines), cb(nlines), cc(nlines);
+
+            sink = 0.0;
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                for (k = 0; k < nlines; k++) {
+                    legacyQuadraticLSF(&xs[offsets[k]], &ys[offsets[k]], offsets[k + 1] - offsets[k], &a, &b, &c);
+                    sink += a * 720.0 * 720.0 + b * 720.0 + c;
+                }
+            }
+            double before = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                math::getQuadraticLSFBatch(xs.data(), ys.data(), offsets.data(), nlines, &arena,
+                                           ca.data(), cb.data(), cc.data(), NULL);
+                for (k = 0; k < nlines; k++)
+                    sink -= ca[k] * 720.0 * 720.0 + cb[k] * 720.0 + cc[k];
+            }
+            double after = elapsedUs(start, iterations);
+
+            report("line fits", nlines, before, after);
+            if (fabs(sink) > 1.0e-6 * nlines * iterations) {
+                printf("  !! results differ (%g)\n", sink);
+                ndiff++;
+            }
+
+            /* column fits against the line mid-points */
+            std::vector<double> midys(nlines), table(nlines * nx), column(nlines);
+            for (k = 0; k < nlines; k++) {
+                midys[k] = 1900.0 * (k + 0.5) / nlines;
+                for (j = 0; j < nx; j++)
+                    table[k * nx + j] = 1.0e-5 * j * (midys[k] - 950.0) * (midys[k] - 950.0) + 0.01 * j;
+            }
+            std::vector<double> da(nx), db(nx), dc(nx);
+
+            sink = 0.0;
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                for (j = 0; j < nx; j++) {
+                    for (k = 0; k < nlines; k++)
+                        column[k] = table[k * nx + j];
+                    legacyQuadraticLSF(midys.data(), column.data(), nlines, &a, &b, &c);
+                    sink += a * 950.0 * 950.0 + b * 950.0 + c;
+                }
+            }
+            before = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                math::getQuadraticLSFColumns(midys.data(), nlines, table.data(), nx, nx,
+                                             da.data(), db.data(), dc.data(), NULL);
+                for (j = 0; j < nx; j++)
+                    sink -= da[j] * 950.0 * 950.0 + db[j] * 950.0 + dc[j];
+            }
+            after = elapsedUs(start, iterations);
+
+            report("column fits (nx = 73)", nlines, before, after);
+            if (fabs(sink) > 1.0e-6 * nx * iterations) {
+                printf("  !! results differ (%g)\n", sink);
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* Left and right margin fits on transposed end points with one in
+     * nine lines pulled in by a heading or a short line.  "before" is
+     * the plain dewarpQuadraticLSF on both margins; the error columns
+     * are the worst distance from the true margin, in pixels, and the
+     * robust fit must stay within a pixel of it. */
+    int marginFits(int iterations) {
+        int sizes[] = { 20, 60, 200 };
+        int i, j, it, n, niters, ndiff;
+        double y, truth, errBefore, errAfter, cl[3], cr[3], a, b, c, mederr;
+        Arena arena;
+
+        header("margin fits (plain LSF vs robust)");
+        ndiff = 0;
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+            n = sizes[i];
+            vectorPointD ptal, ptar;
+            for (j = 0; j < n; j++) {
+                y = 1900.0 * j / n;
+                truth = 1.0e-5 * (y - 950.0) * (y - 950.0) + 100.0;
+                double pull = (j % 9 == 4) ? 300.0 : 0.0;
+                ptal.push_back((DPoint){ .x = y, .y = truth + pull });
+                ptar.push_back((DPoint){ .x = y, .y = 1340.0 - truth - pull });
+            }
+
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                math::dewarpQuadraticLSF(&ptal, &a, &b, &c, &mederr);
+                math::dewarpQuadraticLSF(&ptar, &a, &b, &c, &mederr);
+            }
+            double before = elapsedUs(start, iterations);
+            math::dewarpQuadraticLSF(&ptal, &a, &b, &c, &mederr);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                math::dewarpRobustMarginLSF(&ptal, &ptar, 10, &arena, cl, cr, NULL, NULL, &niters);
+            double after = elapsedUs(start, iterations);
+
+            errBefore = errAfter = 0.0;
+            for (y = 0.0; y < 1900.0; y += 20.0) {
+                truth = 1.0e-5 * (y - 950.0) * (y - 950.0) + 100.0;
+                errBefore = fmax(errBefore, fabs((a * y + b) * y + c - truth));
+                errAfter = fmax(errAfter, fabs((cl[0] * y + cl[1]) * y + cl[2] - truth));
+            }
+
+            report("both margins", n, before, after);
+            printf("  max error %.2f px -> %.2f px, %i iterations\n", errBefore, errAfter, niters);
+            if (errAfter > 1.0) {
+                printf("  !! robust fit off the margin\n");
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* A smooth synthetic vertical disparity on the 20 px grid that
+     * DisparityModel uses for a w x h image */
+    static void disparityGrid(int w, int h, int sampling, fieldD *grid) {
+        int i, j, nx, ny;
+
+        nx = (w + 2 * sampling - 2) / sampling;
+        ny = (h + 2 * sampling - 2) / sampling;
+        grid->resize(nx, ny);
+        for (i = 0; i < ny; i++) {
+            for (j = 0; j < nx; j++)
+                grid->at(i, j) = 15.0 * sin(0.1 * i) + 0.01 * (j - nx / 2) * (j - nx / 2);
+        }
+    }
+
+    /* Smooth RGBA test pattern, for comparing interpolated warps whose
+     * sample positions differ by a fraction of a pixel; on noise any
+     * such shift is a large difference */
+    static void smoothImage(int w, int h, int d, std::vector<uint8_t> *pimage) {
+        int i, j, k;
+
+        pimage->resize((size_t)w * h * d);
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                for (k = 0; k < d; k++)
+                    (*pimage)[((size_t)i * w + j) * d + k] =
+                        (uint8_t)(127.5 + 100.0 * sin(0.07 * j + k) * cos(0.05 * i + 0.5 * k));
+            }
+        }
+    }
+
+    /* The vertical warp, then the horizontal warp on its output, from
+     * the full resolution disparities, with nearest sampling and the
+     * rounding applyDisparity documents */
+    static void twoPassNearest(const std::vector<uint8_t> &src, int w, int h, int d,
+                               const fieldD &vfull, const fieldD &hfull,
+                               std::vector<uint8_t> *pdst) {
+        int i, j, k, r, c;
+        std::vector<uint8_t> vpass(src.size());
+
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                r = std::min(std::max((int)(i - vfull.at(i, j) + 0.5), 0), h - 1);
+                for (k = 0; k < d; k++)
+                    vpass[((size_t)i * w + j) * d + k] = src[((size_t)r * w + j) * d + k];
+            }
+        }
+        pdst->resize(src.size());
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                c = std::min(std::max((int)(j - hfull.at(i, j) + 0.5), 0), w - 1);
+                for (k = 0; k < d; k++)
+                    (*pdst)[((size_t)i * w + j) * d + k] = vpass[((size_t)i * w + c) * d + k];
+            }
+        }
+    }
+
+    /* The vertical warp with bilinear sampling, in double */
+    static void verticalBilinear(const std::vector<uint8_t> &src, int w, int h, int d,
+                                 const fieldD &vfull, std::vector<double> *pdst) {
+        int i, j, k, r;
+        double y, t;
+
+        pdst->resize(src.size());
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                y = std::min(std::max(i - vfull.at(i, j), 0.0), (double)(h - 1));
+                r = (int)y;
+                t = y - r;
+                for (k = 0; k < d; k++)
+                    (*pdst)[((size_t)i * w + j) * d + k] =
+                        (1.0 - t) * src[((size_t)r * w + j) * d + k] +
+                        t * src[((size_t)std::min(r + 1, h - 1) * w + j) * d + k];
+            }
+        }
+    }
+
+    /* The same two passes with bilinear sampling, in double and with no
+     * rounding in between */
+    static void twoPassBilinear(const std::vector<uint8_t> &src, int w, int h, int d,
+                                const fieldD &vfull, const fieldD &hfull,
+                                std::vector<double> *pdst) {
+        int i, j, k, c;
+        double x, t;
+        std::vector<double> vpass;
+
+        verticalBilinear(src, w, h, d, vfull, &vpass);
+        pdst->resize(src.size());
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                x = std::min(std::max(j - hfull.at(i, j), 0.0), (double)(w - 1));
+                c = (int)x;
+                t = x - c;
+                for (k = 0; k < d; k++)
+                    (*pdst)[((size_t)i * w + j) * d + k] =
+                        (1.0 - t) * vpass[((size_t)i * w + c) * d + k] +
+                        t * vpass[((size_t)i * w + std::min(c + 1, w - 1)) * d + k];
+            }
+        }
+    }
+
+    /* Vertical disparity warp of an RGBA image.  "before" clones the
+     * input, expands the grid to a full resolution map and then remaps
+     * byte by byte with checked accesses, as DisparityModel apply: did. */
+    int verticalRemaps(int iterations) {
+        int sizes[][2] = { { 1440, 1920 }, { 4000, 6000 } };
+        int i, j, k, it, w, h, d, wpl, isrc, sampling, ndiff;
+        double maxdiff;
+        Arena arena;
+
+        header("vertical disparity remap (RGBA)");
+        ndiff = 0;
+        d = 4;
+        sampling = 20;
+        for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+            w = sizes[k][0];
+            h = sizes[k][1];
+            wpl = w * d;
+            fieldD grid;
+            disparityGrid(w, h, sampling, &grid);
+            std::vector<uint8_t> src((size_t)wpl * h), before, after((size_t)wpl * h);
+            for (i = 0; i < (int)src.size(); i++)
+                src[i] = (uint8_t)rand();
+
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++) {
+                before = src;
+                fieldD full;
+                dewarp::scaleByInteger(&grid, sampling, &full);
+                for (i = 0; i < h; i++) {
+                    for (j = 0; j < wpl; j++) {
+                        isrc = (int)(i - full.at(i, j / d) + 0.5);
+                        isrc = std::min(std::max(isrc, 0), h - 1);
+                        before.at((size_t)i * wpl + j) = src.at((size_t)isrc * wpl + j);
+                    }
+                }
+            }
+            double tbefore = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                remap::applyVerticalDisparity(src.data(), w, h, d, wpl, &grid, sampling, &arena,
+                                              after.data(), wpl, remap::REMAP_NEAREST);
+            double tafter = elapsedUs(start, iterations);
+
+            report("gather remap, nearest", w * h, tbefore, tafter);
+            if (before != after) {
+                printf("  !! results differ\n");
+                ndiff++;
+            }
+
+            /* the row threads on their own, against one thread */
+            parallel::setThreadLimit(1);
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                remap::applyVerticalDisparity(src.data(), w, h, d, wpl, &grid, sampling, &arena,
+                                              after.data(), wpl, remap::REMAP_NEAREST);
+            double tsingle = elapsedUs(start, iterations);
+            parallel::setThreadLimit(0);
+            char name[32];
+            snprintf(name, sizeof(name), "nearest, 1 vs %d threads", parallel::threadCount());
+            report(name, w * h, tsingle, tafter);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                remap::applyVerticalDisparity(src.data(), w, h, d, wpl, &grid, sampling, &arena,
+                                              after.data(), wpl, remap::REMAP_BILINEAR);
+            tafter = elapsedUs(start, iterations);
+            report("gather remap, bilinear", w * h, tbefore, tafter);
+            std::vector<double> exact;
+            fieldD vfull;
+            dewarp::scaleByInteger(&grid, sampling, &vfull);
+            verticalBilinear(src, w, h, d, vfull, &exact);
+            maxdiff = 0.0;
+            for (i = 0; i < (int)after.size(); i++)
+                maxdiff = std::max(maxdiff, fabs(after[i] - exact[i]));
+            printf("  bilinear: max diff %.2f from double\n", maxdiff);
+            if (maxdiff > kBilinearTolerance) {
+                printf("  !! bilinear off the double reference\n");
+                ndiff++;
+            }
+
+            /* one pass with both corrections against vertical only; the
+             * margins move by a few pixels, not by the line curvature */
+            fieldD hgrid;
+            disparityGrid(w, h, sampling, &hgrid);
+            dewarp::addMultConstant(&hgrid, 0.0, 0.2);
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                remap::applyVerticalDisparity(src.data(), w, h, d, wpl, &grid, sampling, &arena,
+                                              after.data(), wpl, remap::REMAP_NEAREST);
+            tbefore = elapsedUs(start, iterations);
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                remap::applyDisparity(src.data(), w, h, d, wpl, &grid, &hgrid, sampling, &arena,
+                                      after.data(), wpl, remap::REMAP_NEAREST);
+            tafter = elapsedUs(start, iterations);
+            report("h + v, one pass", w * h, tbefore, tafter);
+
+            /* Nearest matches the two passes exactly.  Bilinear reads the
+             * vertical disparity at the rounded source column for both
+             * columns it blends, and rounds once, so it is held to
+             * kTwoPassTolerance levels of a smooth image instead. */
+            fieldD hfull;
+            std::vector<uint8_t> twopass, smooth;
+            dewarp::scaleByInteger(&hgrid, sampling, &hfull);
+            twoPassNearest(src, w, h, d, vfull, hfull, &twopass);
+            if (twopass != after) {
+                printf("  !! h + v nearest differs from two passes\n");
+                ndiff++;
+            }
+            smoothImage(w, h, d, &smooth);
+            remap::applyDisparity(smooth.data(), w, h, d, wpl, &grid, &hgrid, sampling, &arena,
+                                  after.data(), wpl, remap::REMAP_BILINEAR);
+            twoPassBilinear(smooth, w, h, d, vfull, hfull, &exact);
+            maxdiff = 0.0;
+            for (i = 0; i < (int)after.size(); i++)
+                maxdiff = std::max(maxdiff, fabs(after[i] - exact[i]));
+            printf("  h + v bilinear: max diff %.2f from two passes\n", maxdiff);
+            if (maxdiff > kTwoPassTolerance) {
+                printf("  !! h + v bilinear off the two passes\n");
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* Full resolution disparity from the sampled grid.  "before" is the
+     * scalar double bilinear, "after" the float32 separable path. */
+    int scaleByIntegers(int iterations) {
+        int sizes[][2] = { { 1440, 1920 }, { 4000, 6000 } };
+        int i, j, k, it, w, h, sampling, ndiff;
+        double maxdiff, maxval;
+
+        header("disparity upsampling");
+        ndiff = 0;
+        sampling = 20;
+        for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+            w = sizes[k][0];
+            h = sizes[k][1];
+            fieldD grid;
+            disparityGrid(w, h, sampling, &grid);
+            fieldD before;
+            fieldF after;
+
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                dewarp::scaleByInteger(&grid, sampling, &before);
+            double tbefore = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                dewarp::scaleByInteger(&grid, sampling, &after);
+            double tafter = elapsedUs(start, iterations);
+
+            report("float32 separable", before.width() * before.height(), tbefore, tafter);
+            maxdiff = maxval = 0.0;
+            for (i = 0; i < before.height(); i++) {
+                for (j = 0; j < before.width(); j++) {
+                    maxdiff = std::max(maxdiff, fabs(before.at(i, j) - (double)after.at(i, j)));
+                    maxval = std::max(maxval, fabs(before.at(i, j)));
+                }
+            }
+            printf("  max abs diff %.3g (field max %.3g)\n", maxdiff, maxval);
+            if (maxdiff > 1.0e-6 * std::max(maxval, 1.0)) {
+                printf("  !! results differ\n");
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* The fitting half of getVerticalDisparity: a batch of line fits,
+     * the lines sampled across the grid, the column fits down it and
+     * the grid sampled from them */
+    static void fitDisparity(const std::vector<double> &xs,
+                             const std::vector<double> &ys,
+                             const std::vector<int> &offsets,
+                             int nx,
+                             int ny,
+                             int sampling,
+                             Arena *arena,
+                             fieldD *grid) {
+        int k, nlines;
+
+        ArenaScope scope(arena);
+        nlines = (int)offsets.size() - 1;
+        double *ca = arena->alloc<double>(nlines), *cb = arena->alloc<double>(nlines);
+        double *cc = arena->alloc<double>(nlines), *midys = arena->alloc<double>(nlines);
+        double *curves = arena->alloc<double>((size_t)nlines * nx);
+        double *da = arena->alloc<double>(nx), *db = arena->alloc<double>(nx), *dc = arena->alloc<double>(nx);
+        math::getQuadraticLSFBatch(xs.data(), ys.data(), offsets.data(), nlines, arena, ca, cb, cc, NULL);
+        math::evaluateQuadraticRows(ca, cb, cc, nlines, 0.0, sampling, nx, curves, nx);
+        for (k = 0; k < nlines; k++) {
+            double *curve = curves + (size_t)k * nx;
+            midys[k] = curve[nx / 2];
+            for (int j = 0; j < nx; j++)
+                curve[j] = midys[k] - curve[j];
+        }
+        math::getQuadraticLSFColumns(midys, nlines, curves, nx, nx, da, db, dc, NULL);
+        math::evaluateQuadraticColumns(da, db, dc, nx, 0.0, sampling, ny, grid->row(0), grid->stride());
+    }
+
+    int disparityFits(int iterations) {
+        int samplings[] = { 20, 10, 5 };
+        int i, j, k, it, w, h, nlines, npts, nx, ny, sampling, ndiff;
+        double maxdiff;
+        Arena arena;
+
+        header("vertical disparity fits, 1 thread vs all");
+        ndiff = 0;
+        w = 1440;
+        h = 1920;
+        for (i = 0; i < (int)(sizeof(samplings) / sizeof(samplings[0])); i++) {
+            sampling = samplings[i];
+            nx = (w + 2 * sampling - 2) / sampling;
+            ny = (h + 2 * sampling - 2) / sampling;
+
+            /* one key point every sampling px along each line */
+            nlines = 60;
+            std::vector<int> offsets(nlines + 1);
+            std::vector<double> xs, ys;
+            for (k = 0; k < nlines; k++) {
+                offsets[k] = (int)xs.size();
+                npts = w / sampling;
+                double y0 = 40.0 + (h - 80.0) * k / nlines;
+                double curve = 2.0e-5 * (1.0 - 2.0 * y0 / h);
+                for (j = 0; j < npts; j++) {
+                    double x = (double)w * j / npts;
+                    xs.push_back(x);
+                    ys.push_back(curve * (x - 720.0) * (x - 720.0) + y0);
+                }
+            }
+            offsets[nlines] = (int)xs.size();
+            fieldD before(nx, ny), after(nx, ny);
+
+            parallel::setThreadLimit(1);
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                fitDisparity(xs, ys, offsets, nx, ny, sampling, &arena, &before);
+            double tbefore = elapsedUs(start, iterations);
+
+            parallel::setThreadLimit(0);
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                fitDisparity(xs, ys, offsets, nx, ny, sampling, &arena, &after);
+            double tafter = elapsedUs(start, iterations);
+
+            char name[32];
+            snprintf(name, sizeof(name), "sampling %d", sampling);
+            report(name, nx * ny, tbefore, tafter);
+            maxdiff = 0.0;
+            for (j = 0; j < ny; j++) {
+                for (k = 0; k < nx; k++)
+                    maxdiff = std::max(maxdiff, fabs(before.at(j, k) - after.at(j, k)));
+            }
+            if (maxdiff > 0.0) {
+                printf("  !! results differ (%g)\n", maxdiff);
+                ndiff++;
+            }
+        }
+        printf("  %d threads\n", parallel::threadCount());
+        printf("----------------------------\n");
+        return ndiff;
+    }
+
+    /* Word-sized contours laid out in text lines, start and end points
+     * along each word; the page grows with the count, so the density
+     * of text stays that of a dense page */
+    static void textContours(int n,
+                             std::vector<double> *sx,
+                             std::vector<double> *sy,
+                             std::vector<double> *ex,
+                             std::vector<double> *ey) {
+        int i, perline;
+        double x, y, w;
+
+        perline = 16;
+        sx->resize(n);
+        sy->resize(n);
+        ex->resize(n);
+        ey->resize(n);
+        for (i = 0; i < n; i++) {
+            w = 30.0 + rand() % 60;
+            x = 20.0 + 85.0 * (i % perline) + rand() % 10;
+            y = 40.0 + 32.0 * (i / perline) + rand() % 5;
+            (*sx)[i] = x;
+            (*sy)[i] = y;
+            (*ex)[i] = x + w;
+            (*ey)[i] = y + (rand() % 5) - 2.0;
+        }
+    }
+
+    /* The all pairs test that generateContourEdgesFromContours: made
+     * before the grid: every pair, both ways round */
+    static void allPairsWithin(const std::vector<double> &sx,
+                               const std::vector<double> &sy,
+                               const std::vector<double> &ex,
+                               const std::vector<double> &ey,
+                               double radius,
+                               std::vector<std::pair<int, int> > *ppairs) {
+        int i, j, n;
+        double d1, d2;
+
+        n = (int)sx.size();
+        ppairs->clear();
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < i; j++) {
+                d1 = hypot(sx[j] - ex[i], sy[j] - ey[i]);
+                d2 = hypot(sx[i] - ex[j], sy[i] - ey[j]);
+                if (d1 <= radius || d2 <= radius)
+                    ppairs->push_back(std::make_pair(i, j));
+            }
+        }
+    }
+
+    int contourEdges(int iterations) {
+        int counts[] = { 250, 500, 1000, 2000, 4000 };
+        int i, it, n, ndiff;
+        double radius = 100.0;
+
+        header("contour edge candidates, all pairs vs grid");
+        ndiff = 0;
+        for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++) {
+            n = counts[i];
+            std::vector<double> sx, sy, ex, ey;
+            std::vector<std::pair<int, int> > before, after;
+            textContours(n, &sx, &sy, &ex, &ey);
+
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                allPairsWithin(sx, sy, ex, ey, radius, &before);
+            double tbefore = elapsedUs(start, iterations);
+
+            start = high_resolution_clock::now();
+            for (it = 0; it < iterations; it++)
+                PointGrid::pairsWithin(&sx[0], &sy[0], &ex[0], &ey[0], n, radius, &after);
+            double tafter = elapsedUs(start, iterations);
+
+            report("contours", n, tbefore, tafter);
+            printf("  %.2f us per contour, %d candidate pairs\n", tafter / n, (int)after.size());
+            if (before != after) {
+                printf("  !! candidates differ (%d vs %d)\n", (int)before.size(), (int)after.size());
+                ndiff++;
+            }
+        }
+        printf("----------------------------\n");
+        return ndiff;
+    }
+}
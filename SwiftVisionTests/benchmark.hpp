@@ -0,0 +1,23 @@
+#ifndef benchmark_hpp
+#define benchmark_hpp
+
+/*----------------------------------------------------------------------------*
+ *  Micro benchmarks for the dewarp helpers.  Each function runs the old      *
+ *  and the new implementation on the same synthetic input, prints the        *
+ *  average time per call, and returns the number of cases where the two      *
+ *  disagree (0 when the new one matches).  Built into SwiftVisionTests       *
+ *  only; the tests assert on the return values.                              *
+ *----------------------------------------------------------------------------*/
+
+namespace benchmark {
+    int rankStatistics(int iterations);
+    int smallSorts(int iterations);
+    int quadraticFits(int iterations);
+    int marginFits(int iterations);
+    int verticalRemaps(int iterations);
+    int scaleByIntegers(int iterations);
+    int disparityFits(int iterations);
+    int contourEdges(int iterations);
+}
+
+#endif /* benchmark_hpp */